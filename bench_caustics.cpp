@@ -0,0 +1,54 @@
+﻿#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
+#include "render.h"
+#include "sppm.h"
+#include "bench_util.h"
+
+// ガラス球のシーンで、パストレーシングとSPPMの時間あたりの誤差を比較する。
+// パストレーシングの高サンプル数の画像を参照解とし、サンプル数（パス数）を倍々に増やしながら
+// レンダリング時間と参照解に対するRMSE、相対MSE、効率（gemspt::efficiency()）を出力する。
+//
+// usage: bench_caustics [幅] [高さ] [参照解のサブピクセルごとのサンプリング数] [最大ステップ数] [パスあたりの光子数]
+
+int main(int argc, char **argv) {
+    const int width         = argc > 1 ? atoi(argv[1]) : 80;
+    const int height        = argc > 2 ? atoi(argv[2]) : 60;
+    const int reference_spp = argc > 3 ? atoi(argv[3]) : 1024;
+    const int num_step      = argc > 4 ? atoi(argv[4]) : 6;
+    const int num_photon    = argc > 5 ? atoi(argv[5]) : 20000;
+    const int num_subpixel = 2;
+    const double initial_radius = 0.1;
+
+    gemspt::Scene scene;
+    gemspt::setup_builtin_scene(&scene, gemspt::kSceneGlass);
+
+    std::vector<gemspt::Color> reference(width * height), image(width * height);
+    std::cout << "rendering reference (" << reference_spp * num_subpixel * num_subpixel << " spp)" << std::endl;
+    gemspt::render_image(scene, width, height, reference_spp, num_subpixel, 1, false, &reference[0]);
+
+    std::cout << "method, samples per pixel, seconds, rmse, relMSE, efficiency" << std::endl;
+    for (int step = 0; step < num_step; ++step) {
+        const int num_sample = 1 << step;
+
+        const std::chrono::steady_clock::time_point start_pt = std::chrono::steady_clock::now();
+        gemspt::render_image(scene, width, height, num_sample, num_subpixel, 2, false, &image[0]);
+        const double seconds_pt = gemspt::elapsed_seconds(start_pt);
+        const double relative_mse_pt = gemspt::relative_mse(image, reference);
+        std::cout << "path tracing, " << num_sample * num_subpixel * num_subpixel << ", " << seconds_pt << ", " << gemspt::rmse(image, reference)
+                  << ", " << relative_mse_pt << ", " << gemspt::efficiency(relative_mse_pt, seconds_pt) << std::endl;
+
+        // SPPMは1パスで1ピクセルあたり1サンプル。
+        const int num_pass = num_sample * num_subpixel * num_subpixel;
+        const std::chrono::steady_clock::time_point start_sppm = std::chrono::steady_clock::now();
+        gemspt::render_sppm_image(scene, width, height, num_subpixel, num_pass, num_photon, initial_radius, 2, false, &image[0]);
+        const double seconds_sppm = gemspt::elapsed_seconds(start_sppm);
+        const double relative_mse_sppm = gemspt::relative_mse(image, reference);
+        std::cout << "sppm, " << num_pass << ", " << seconds_sppm << ", " << gemspt::rmse(image, reference)
+                  << ", " << relative_mse_sppm << ", " << gemspt::efficiency(relative_mse_sppm, seconds_sppm) << std::endl;
+    }
+
+    return 0;
+}
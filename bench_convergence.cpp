@@ -0,0 +1,238 @@
+﻿#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include "render.h"
+#include "pfm.h"
+#include "bench_util.h"
+
+// 組み込みシーンごとに、時間あたりの画質（参照解に対する誤差）を計る。
+// サブピクセルごとのサンプリング数を倍々に増やしながらレンダリングし、経過時間とRMSE、相対MSEを記録する。
+// 参照解は高サンプル数でレンダリングしたPFM画像で、参照解のディレクトリに無いか、サンプル数か解像度が違えばレンダリングして保存する。
+// 参照解の分散も誤差に含まれるので、参照解のサンプル数は計測するサンプル数より十分大きくすること。
+// サブピクセルの位置は固定なので、参照解と計測で同じサブピクセルの縦横解像度を使う。
+//
+// 結果は[出力ファイル名].csvと[出力ファイル名].jsonに書き出す。
+// 比較対象のCSV（以前の結果）を渡すと、シーンごとに共通するサンプル数で相対MSEと時間を別々に比べ、
+// どちらかが悪化しているか、共通するサンプル数が無くて比べられなければ終了コード1を返す。radiance()のサンプリングや積分法を変えたときの受け入れテストに使う。
+// 乱数の種は固定なので相対MSEは同じコードなら毎回同じになり、厳しく比べられる。
+// 時間は計測のばらつきがあるので、各ステップをkNumRepeat回レンダリングした最小値を使い、kMinSeconds未満の短いステップは比べない。
+// 比べるステップの時間は合計してから比べるので、長く安定したステップほど重く効く。
+//
+// usage: bench_convergence [参照解のディレクトリ] [幅] [高さ] [参照解のサブピクセルごとのサンプリング数]
+//                          [シーンごとの時間予算（秒）] [出力ファイル名] [比較対象のCSV]
+
+namespace {
+
+const int kNumSubpixel = 2;
+const int kMaxStep = 16;
+const int kNumRepeat = 3;
+// 比較対象に対する相対MSEの比（共通するサンプル数での幾何平均）がこれを上回れば悪化とみなす。
+const double kRelativeMseTolerance = 1.05;
+// 比較対象に対する速度の比（比べるステップの合計時間の比）がこれを下回れば悪化とみなす。時間の計測誤差を見込んで余裕を持たせる。
+const double kSpeedTolerance = 0.8;
+// これより短いステップはタイマーやスレッドの起動の影響が大きいので、時間を比べない。
+const double kMinSeconds = 0.1;
+
+struct ErrorPoint {
+    int spp;
+    double seconds;
+    double rmse;
+    double relative_mse;
+
+    double efficiency() const {
+        return gemspt::efficiency(relative_mse, seconds);
+    }
+};
+
+// 参照解のサンプル数を記録するファイル。PFMには注釈を書けないので、[参照解].txtに"サブピクセルごとのサンプリング数 サブピクセルの解像度"を書く。
+bool load_reference_info(const std::string &filename, int *reference_spp, int *num_subpixel) {
+    std::ifstream file(filename.c_str());
+    return file && (file >> *reference_spp >> *num_subpixel);
+}
+
+bool save_reference_info(const std::string &filename, const int reference_spp, const int num_subpixel) {
+    std::ofstream file(filename.c_str());
+    return file && (file << reference_spp << " " << num_subpixel << std::endl);
+}
+
+// 参照解を読み込む。無いか、解像度かサンプル数が違えばレンダリングして保存する。
+bool prepare_reference(const gemspt::Scene &scene, const std::string &filename, const int width, const int height, const int reference_spp,
+                       std::vector<gemspt::Color> *reference) {
+    const std::string info_filename = filename + ".txt";
+    int reference_width = 0, reference_height = 0, saved_spp = 0, saved_subpixel = 0;
+    if (load_reference_info(info_filename, &saved_spp, &saved_subpixel) &&
+        saved_spp == reference_spp && saved_subpixel == kNumSubpixel &&
+        gemspt::load_pfm_file(filename, reference, &reference_width, &reference_height) &&
+        reference_width == width && reference_height == height) {
+        std::cout << "loaded reference " << filename << std::endl;
+        return true;
+    }
+
+    std::cout << "rendering reference " << filename << " (" << reference_spp * kNumSubpixel * kNumSubpixel << " spp)" << std::endl;
+    reference->assign(width * height, gemspt::Color());
+    gemspt::render_image(scene, width, height, reference_spp, kNumSubpixel, 1, false, &(*reference)[0]);
+    if (!gemspt::save_pfm_file(filename, &(*reference)[0], width, height) ||
+        !save_reference_info(info_filename, reference_spp, kNumSubpixel)) {
+        std::cerr << "cannot write " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 以前の結果のCSVを読み込み、シーン名ごとに、サンプル数から計測点への対応を返す。
+bool load_baseline(const std::string &filename, std::map<std::string, std::map<int, ErrorPoint> > *baseline) {
+    std::ifstream file(filename.c_str());
+    if (!file)
+        return false;
+
+    std::string line;
+    std::getline(file, line); // ヘッダ
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string scene, field;
+        std::vector<double> values;
+        std::getline(ss, scene, ',');
+        while (std::getline(ss, field, ','))
+            values.push_back(atof(field.c_str()));
+        if (values.size() == 5) {
+            ErrorPoint &point = (*baseline)[scene][(int)values[0]];
+            point.spp = (int)values[0];
+            point.seconds = values[1];
+            point.rmse = values[2];
+            point.relative_mse = values[3];
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+    const std::string reference_directory = argc > 1 ? argv[1] : ".";
+    const int width           = argc > 2 ? atoi(argv[2]) : 80;
+    const int height          = argc > 3 ? atoi(argv[3]) : 60;
+    const int reference_spp   = argc > 4 ? atoi(argv[4]) : 1024;
+    const double time_budget  = argc > 5 ? atof(argv[5]) : 10.0;
+    const std::string output  = argc > 6 ? argv[6] : "convergence";
+    const std::string baseline_filename = argc > 7 ? argv[7] : "";
+
+    const gemspt::BuiltinScene types[] = { gemspt::kSceneDiffuseOnly, gemspt::kSceneSpecular, gemspt::kSceneGlass };
+    const char *names[] = { "diffuse_only", "specular", "glass" };
+    const int num_scene = 3;
+
+    std::vector<std::vector<ErrorPoint> > curves(num_scene);
+    for (int i = 0; i < num_scene; ++i) {
+        gemspt::Scene scene;
+        gemspt::setup_builtin_scene(&scene, types[i]);
+
+        std::vector<gemspt::Color> reference;
+        if (!prepare_reference(scene, reference_directory + "/reference_" + names[i] + ".pfm", width, height, reference_spp, &reference))
+            return 1;
+
+        // 時間予算を使い切るまでサンプル数を倍々に増やす。
+        std::vector<gemspt::Color> image(width * height);
+        double total_seconds = 0.0;
+        for (int step = 0; step < kMaxStep && total_seconds < time_budget; ++step) {
+            const int num_sample = 1 << step;
+            // 同じ種で繰り返すので画像は毎回同じ。時間は最小値を使う。
+            double seconds = gemspt::kINF;
+            for (int repeat = 0; repeat < kNumRepeat; ++repeat) {
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                gemspt::render_image(scene, width, height, num_sample, kNumSubpixel, step + 2, false, &image[0]);
+                const double repeat_seconds = gemspt::elapsed_seconds(start);
+                seconds = std::min(seconds, repeat_seconds);
+                total_seconds += repeat_seconds;
+            }
+
+            ErrorPoint point;
+            point.spp = num_sample * kNumSubpixel * kNumSubpixel;
+            point.seconds = seconds;
+            point.rmse = gemspt::rmse(image, reference);
+            point.relative_mse = gemspt::relative_mse(image, reference);
+            curves[i].push_back(point);
+            std::cout << names[i] << ": " << point.spp << " spp, " << point.seconds << " s, rmse " << point.rmse
+                      << ", relMSE " << point.relative_mse << std::endl;
+        }
+    }
+
+    // CSVとJSONに書き出す。
+    FILE *csv = fopen((output + ".csv").c_str(), "w");
+    FILE *json = fopen((output + ".json").c_str(), "w");
+    if (csv == NULL || json == NULL) {
+        std::cerr << "cannot write " << output << ".csv / .json" << std::endl;
+        return 1;
+    }
+    fprintf(csv, "scene,spp,seconds,rmse,relative_mse,efficiency\n");
+    fprintf(json, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"reference_spp\": %d,\n  \"scenes\": [\n",
+            width, height, reference_spp * kNumSubpixel * kNumSubpixel);
+    for (int i = 0; i < num_scene; ++i) {
+        fprintf(json, "    {\n      \"name\": \"%s\",\n      \"points\": [\n", names[i]);
+        for (size_t j = 0; j < curves[i].size(); ++j) {
+            const ErrorPoint &p = curves[i][j];
+            fprintf(csv, "%s,%d,%.6g,%.6g,%.6g,%.6g\n", names[i], p.spp, p.seconds, p.rmse, p.relative_mse, p.efficiency());
+            fprintf(json, "        {\"spp\": %d, \"seconds\": %.6g, \"rmse\": %.6g, \"relative_mse\": %.6g, \"efficiency\": %.6g}%s\n",
+                    p.spp, p.seconds, p.rmse, p.relative_mse, p.efficiency(), j + 1 < curves[i].size() ? "," : "");
+        }
+        fprintf(json, "      ]\n    }%s\n", i + 1 < num_scene ? "," : "");
+    }
+    fprintf(json, "  ]\n}\n");
+    fclose(csv);
+    fclose(json);
+    std::cout << "wrote " << output << ".csv, " << output << ".json" << std::endl;
+
+    if (baseline_filename.empty())
+        return 0;
+
+    // 比較対象と共通するサンプル数での相対MSEの比の幾何平均と、合計時間の比をシーンごとに求める。
+    std::map<std::string, std::map<int, ErrorPoint> > baseline;
+    if (!load_baseline(baseline_filename, &baseline)) {
+        std::cerr << "cannot read " << baseline_filename << std::endl;
+        return 1;
+    }
+    bool regressed = false;
+    for (int i = 0; i < num_scene; ++i) {
+        const std::map<int, ErrorPoint> &points = baseline[names[i]];
+        double log_error_ratio = 0.0, baseline_seconds = 0.0, seconds = 0.0;
+        int num_common = 0, num_timed = 0;
+        for (size_t j = 0; j < curves[i].size(); ++j) {
+            const std::map<int, ErrorPoint>::const_iterator it = points.find(curves[i][j].spp);
+            if (it == points.end() || !(it->second.relative_mse > 0.0))
+                continue;
+            log_error_ratio += log(curves[i][j].relative_mse / it->second.relative_mse);
+            ++num_common;
+            if (curves[i][j].seconds >= kMinSeconds && it->second.seconds >= kMinSeconds) {
+                baseline_seconds += it->second.seconds;
+                seconds += curves[i][j].seconds;
+                ++num_timed;
+            }
+        }
+        // 比べられなければ悪化を見逃すので、失敗として扱う。
+        if (num_common == 0) {
+            std::cout << names[i] << ": no common sample counts with baseline (failed)" << std::endl;
+            regressed = true;
+            continue;
+        }
+        const double error_ratio = exp(log_error_ratio / num_common);
+        const bool error_ok = error_ratio <= kRelativeMseTolerance;
+        regressed = regressed || !error_ok;
+        std::cout << names[i] << ": relMSE " << error_ratio << "x of baseline" << (error_ok ? "" : " (regressed)");
+        if (num_timed == 0) {
+            std::cout << ", no step longer than " << kMinSeconds << " s to compare time" << std::endl;
+            continue;
+        }
+        const double speed_ratio = baseline_seconds / seconds;
+        const bool speed_ok = speed_ratio >= kSpeedTolerance;
+        regressed = regressed || !speed_ok;
+        std::cout << ", speed " << speed_ratio << "x of baseline over " << num_timed << " steps" << (speed_ok ? "" : " (regressed)") << std::endl;
+    }
+    return regressed ? 1 : 0;
+}
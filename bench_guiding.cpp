@@ -0,0 +1,60 @@
+﻿#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
+#include "render.h"
+#include "bench_util.h"
+
+// 組み込みシーンで、BRDFだけのサンプリングとパスガイディングの同じサンプル数あたりの誤差を比較する。
+// パスガイディングは学習のパスも含めた合計のサンプル数を揃える。学習のパスは1, 2, 4, ...サンプルで、
+// 合計の半分以下に収まるだけ行い、残りを最後のパスに使う。
+// 参照解はBRDFだけのサンプリングで独立な乱数列でレンダリングした高サンプル数の画像。
+// 効率はgemspt::efficiency()で比べる。
+//
+// usage: bench_guiding [幅] [高さ] [参照解のサブピクセルごとのサンプリング数] [ステップ数]
+
+int main(int argc, char **argv) {
+    const int width         = argc > 1 ? atoi(argv[1]) : 80;
+    const int height        = argc > 2 ? atoi(argv[2]) : 60;
+    const int reference_spp = argc > 3 ? atoi(argv[3]) : 1024;
+    const int num_step      = argc > 4 ? atoi(argv[4]) : 7;
+    const int num_subpixel = 2;
+
+    const gemspt::BuiltinScene types[] = { gemspt::kSceneDiffuseOnly, gemspt::kSceneSpecular, gemspt::kSceneGlass };
+    const char *names[] = { "diffuse only", "specular", "glass" };
+    for (int i = 0; i < 3; ++i) {
+        gemspt::Scene scene;
+        gemspt::setup_builtin_scene(&scene, types[i]);
+
+        std::vector<gemspt::Color> reference(width * height), image(width * height);
+        std::cout << names[i] << ": rendering reference (" << reference_spp * num_subpixel * num_subpixel << " spp)" << std::endl;
+        gemspt::render_image(scene, width, height, reference_spp, num_subpixel, 1, false, &reference[0]);
+
+        std::cout << "scene, method, samples per pixel, seconds, rmse, relMSE, efficiency" << std::endl;
+        for (int step = 0; step < num_step; ++step) {
+            const int num_sample = 1 << step;
+
+            const std::chrono::steady_clock::time_point start_bsdf = std::chrono::steady_clock::now();
+            gemspt::render_image(scene, width, height, num_sample, num_subpixel, 2, false, &image[0]);
+            const double seconds_bsdf = gemspt::elapsed_seconds(start_bsdf);
+            const double relative_mse_bsdf = gemspt::relative_mse(image, reference);
+            std::cout << names[i] << ", bsdf, " << num_sample * num_subpixel * num_subpixel << ", " << seconds_bsdf << ", "
+                      << gemspt::rmse(image, reference) << ", " << relative_mse_bsdf << ", " << gemspt::efficiency(relative_mse_bsdf, seconds_bsdf) << std::endl;
+
+            int num_training_pass = 0;
+            while ((2 << num_training_pass) - 1 <= num_sample / 2)
+                ++num_training_pass;
+            const int num_final_sample = num_sample - ((1 << num_training_pass) - 1);
+
+            const std::chrono::steady_clock::time_point start_guided = std::chrono::steady_clock::now();
+            gemspt::render_guided_image(scene, width, height, num_final_sample, num_subpixel, num_training_pass, 2, false, &image[0]);
+            const double seconds_guided = gemspt::elapsed_seconds(start_guided);
+            const double relative_mse_guided = gemspt::relative_mse(image, reference);
+            std::cout << names[i] << ", guided, " << num_sample * num_subpixel * num_subpixel << ", " << seconds_guided << ", "
+                      << gemspt::rmse(image, reference) << ", " << relative_mse_guided << ", " << gemspt::efficiency(relative_mse_guided, seconds_guided) << std::endl;
+        }
+    }
+
+    return 0;
+}
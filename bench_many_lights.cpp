@@ -0,0 +1,44 @@
+﻿#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
+#include "render.h"
+#include "bench_util.h"
+
+// 多数光源シーンで、一様な光源選択とLightTreeによる光源選択の効率を比較する。
+// 独立な乱数列で二枚レンダリングし、その差から一枚あたりの分散（相対MSE）を見積もる。
+// 効率はgemspt::efficiency()で比べる。
+//
+// usage: bench_many_lights [光源数] [幅] [高さ] [サブピクセルごとのサンプリング数]
+
+int main(int argc, char **argv) {
+    const int num_lights = argc > 1 ? atoi(argv[1]) : 10000;
+    const int width      = argc > 2 ? atoi(argv[2]) : 64;
+    const int height     = argc > 3 ? atoi(argv[3]) : 48;
+    const int num_sample = argc > 4 ? atoi(argv[4]) : 1;
+    const int num_subpixel = 2;
+
+    gemspt::Scene scene;
+    gemspt::setup_many_lights_scene(&scene, num_lights, 1234);
+    std::cout << "many lights benchmark: " << scene.num_lights() << " lights, " << scene.num_objects() << " objects, "
+              << width << "x" << height << " " << num_sample * num_subpixel * num_subpixel << " spp" << std::endl;
+
+    const gemspt::LightSelection selections[] = { gemspt::kLightSelectionUniform, gemspt::kLightSelectionTree };
+    const char *names[] = { "uniform", "tree" };
+    for (int i = 0; i < 2; ++i) {
+        scene.set_light_selection(selections[i]);
+
+        std::vector<gemspt::Color> image_a(width * height), image_b(width * height);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        gemspt::render_image(scene, width, height, num_sample, num_subpixel, 1, false, &image_a[0]);
+        gemspt::render_image(scene, width, height, num_sample, num_subpixel, 2, false, &image_b[0]);
+        const double seconds = gemspt::elapsed_seconds(start) / 2.0;
+
+        const double relative_mse = gemspt::estimate_relative_mse(image_a, image_b);
+        std::cout << names[i] << ": " << seconds << " sec/image, relMSE " << relative_mse
+                  << ", efficiency " << gemspt::efficiency(relative_mse, seconds) << std::endl;
+    }
+
+    return 0;
+}
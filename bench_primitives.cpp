@@ -0,0 +1,178 @@
+﻿#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+
+#include "render.h"
+#include "bench_util.h"
+
+// 拡散面の組み込みシーンを、壁と右の球の表し方だけを変えて作り、交差判定とレンダリングの速度を比較する。
+//   sphere walls: 壁を半径1e5の球で近似する（平面を導入する前の表し方）
+//   planes: 壁を無限平面で表す（setup_builtin_scene()と同じ）
+//   rects: 壁を座標軸に平行な長方形で表す
+//   rects + mesh: rectsの右の球を、OBJファイルから読み込んだ三角形メッシュに置き換える
+// 交差判定だけの速度はbench_static_sceneと同じく箱の中からランダムな方向に飛ばしたレイで計る。
+// どれも同じシーンを表すので、planesの画像との相対MSEも出力する（乱数列が分かれるので0にはならない）。
+//
+// usage: bench_primitives [レイの数] [幅] [高さ] [サブピクセルごとのサンプリング数] [OBJファイル]
+// OBJファイルは原点を中心とする半径1の球に収まっていること。省略時はUV球を生成してprimitives_sphere.objに書き出し、それを読み込む。
+
+namespace {
+
+// 手前は開いているので、長方形の壁はカメラの後ろまで十分に伸ばしておく。
+const double kRectFar = 1000.0;
+
+// raysそれぞれについて交差判定をして、かかった時間を返す。
+double intersect_rays(const gemspt::Scene &scene, const std::vector<gemspt::Ray> &rays) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int n = (int)rays.size();
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; ++i) {
+        gemspt::Hitpoint hitpoint;
+        scene.intersect(rays[i], &hitpoint);
+    }
+    return gemspt::elapsed_seconds(start);
+}
+
+// 原点を中心とする半径1のUV球をOBJ形式でfilenameに書き出す。
+bool write_sphere_obj(const std::string &filename, const int num_theta, const int num_phi) {
+    std::ofstream ofs(filename.c_str());
+    if (!ofs)
+        return false;
+    // 極の頂点を一つずつと、その間の緯線ごとにnum_phi個の頂点。
+    ofs << "v 0 1 0" << std::endl;
+    for (int i = 1; i < num_theta; ++i) {
+        const double theta = gemspt::kPI * i / num_theta;
+        for (int j = 0; j < num_phi; ++j) {
+            const double phi = 2.0 * gemspt::kPI * j / num_phi;
+            ofs << "v " << sin(theta) * cos(phi) << " " << cos(theta) << " " << sin(theta) * sin(phi) << std::endl;
+        }
+    }
+    ofs << "v 0 -1 0" << std::endl;
+
+    const int bottom = 2 + (num_theta - 1) * num_phi;
+    for (int j = 0; j < num_phi; ++j) {
+        const int next = (j + 1) % num_phi;
+        ofs << "f 1 " << 2 + next << " " << 2 + j << std::endl;
+        for (int i = 0; i < num_theta - 2; ++i) {
+            const int upper = 2 + i * num_phi;
+            const int lower = upper + num_phi;
+            ofs << "f " << upper + j << " " << upper + next << " " << lower + next << " " << lower + j << std::endl;
+        }
+        const int last = 2 + (num_theta - 2) * num_phi;
+        ofs << "f " << bottom << " " << last + j << " " << last + next << std::endl;
+    }
+    return true;
+}
+
+// 組み込みシーンの平面を、同じ位置で接する半径1e5の球に置き換える。
+gemspt::Sphere wall_sphere(const gemspt::StaticPlane &plane) {
+    const double kRadius = 100000.0;
+    return gemspt::Sphere(kRadius, gemspt::Vec(plane.px - plane.nx * kRadius, plane.py - plane.ny * kRadius, plane.pz - plane.nz * kRadius));
+}
+
+// 組み込みシーンの平面を、箱の範囲で切り取った長方形に置き換える。
+gemspt::Rect wall_rect(const gemspt::StaticPlane &plane) {
+    gemspt::Vec bound_min(-3.0, 0.0, -3.0), bound_max(9.0, 4.0, kRectFar);
+    if (plane.nx != 0.0)
+        bound_min.x = bound_max.x = plane.px;
+    else if (plane.ny != 0.0)
+        bound_min.y = bound_max.y = plane.py;
+    else
+        bound_min.z = bound_max.z = plane.pz;
+    return gemspt::Rect(bound_min, bound_max, gemspt::Vec(plane.nx, plane.ny, plane.nz));
+}
+
+enum WallType {
+    kWallSphere,
+    kWallRect,
+};
+
+// 拡散面の組み込みシーンと同じ配置とマテリアルでシーンを作る。meshがNULLでなければ右の球の代わりに使う。
+void setup_scene(gemspt::Scene *scene, const WallType wall_type, const gemspt::TriangleMesh *mesh) {
+    typedef gemspt::StaticBuiltinScene Layout;
+    const gemspt::Color wall_colors[Layout::kNumPlanes] = {
+        gemspt::Color(0.7, 0.7, 0.7), gemspt::Color(0.7, 0.7, 0.7), gemspt::Color(0.7, 0.1, 0.1), gemspt::Color(0.7, 0.7, 0.7), gemspt::Color(0.1, 0.7, 0.1),
+    };
+    for (int i = 0; i < Layout::kNumPlanes; ++i) {
+        if (wall_type == kWallSphere)
+            scene->add(wall_sphere(Layout::kPlanes[i]), new gemspt::LambertianMaterial(wall_colors[i]));
+        else
+            scene->add(wall_rect(Layout::kPlanes[i]), new gemspt::LambertianMaterial(wall_colors[i]));
+    }
+    scene->add(Layout::kSpheres[0].sphere(), new gemspt::Lightsource(gemspt::Color(8.0, 8.0, 8.0)));
+    scene->add(Layout::kSpheres[1].sphere(), new gemspt::LambertianMaterial(gemspt::Color(0.7, 0.7, 0.7)));
+    if (mesh != NULL)
+        scene->add(*mesh, new gemspt::LambertianMaterial(gemspt::Color(0.1, 0.1, 0.7)));
+    else
+        scene->add(Layout::kSpheres[2].sphere(), new gemspt::LambertianMaterial(gemspt::Color(0.1, 0.1, 0.7)));
+    scene->build();
+}
+
+}
+
+int main(int argc, char **argv) {
+    const int num_ray    = argc > 1 ? atoi(argv[1]) : 10000000;
+    const int width      = argc > 2 ? atoi(argv[2]) : 160;
+    const int height     = argc > 3 ? atoi(argv[3]) : 120;
+    const int num_sample = argc > 4 ? atoi(argv[4]) : 4;
+    std::string obj_filename = argc > 5 ? argv[5] : "";
+    const int num_subpixel = 2;
+
+    if (obj_filename.empty()) {
+        obj_filename = "primitives_sphere.obj";
+        if (!write_sphere_obj(obj_filename, 64, 128)) {
+            std::cerr << "failed to write " << obj_filename << std::endl;
+            return 1;
+        }
+    }
+    gemspt::TriangleMesh mesh;
+    if (!gemspt::load_obj(obj_filename, &mesh)) {
+        std::cerr << "failed to load " << obj_filename << std::endl;
+        return 1;
+    }
+    const gemspt::StaticSphere &right_sphere = gemspt::StaticBuiltinScene::kSpheres[2];
+    mesh.transform(right_sphere.radius, gemspt::Vec(right_sphere.x, right_sphere.y, right_sphere.z));
+    mesh.build();
+    std::cout << obj_filename << ": " << mesh.num_vertices() << " vertices, " << mesh.num_triangles() << " triangles" << std::endl;
+
+    // 箱の中からランダムな方向に飛ばすレイ。
+    std::vector<gemspt::Ray> rays;
+    gemspt::Random random(1234);
+    for (int i = 0; i < num_ray; ++i) {
+        const gemspt::Vec org(random.next(-2.9, 8.9), random.next(0.1, 3.9), random.next(-2.9, 8.9));
+        const double z = random.next(-1.0, 1.0);
+        const double phi = random.next(0.0, 2.0 * gemspt::kPI);
+        const double r = sqrt(1.0 - z * z);
+        rays.push_back(gemspt::Ray(org, gemspt::Vec(r * cos(phi), r * sin(phi), z)));
+    }
+
+    const int kNumVariant = 4;
+    const char *names[kNumVariant] = { "sphere walls", "planes", "rects", "rects + mesh" };
+    gemspt::Scene scenes[kNumVariant];
+    setup_scene(&scenes[0], kWallSphere, NULL);
+    gemspt::setup_builtin_scene(&scenes[1], gemspt::kSceneDiffuseOnly);
+    setup_scene(&scenes[2], kWallRect, NULL);
+    setup_scene(&scenes[3], kWallRect, &mesh);
+
+    std::vector<gemspt::Color> images[kNumVariant];
+    double seconds_intersect[kNumVariant], seconds_render[kNumVariant];
+    for (int i = 0; i < kNumVariant; ++i) {
+        seconds_intersect[i] = intersect_rays(scenes[i], rays);
+
+        images[i].resize(width * height);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        gemspt::render_image(scenes[i], width, height, num_sample, num_subpixel, 1, false, &images[i][0]);
+        seconds_render[i] = gemspt::elapsed_seconds(start);
+    }
+
+    std::cout << "scene, intersect Mrays/s, render seconds, relMSE vs planes" << std::endl;
+    for (int i = 0; i < kNumVariant; ++i) {
+        std::cout << names[i] << ", " << num_ray / seconds_intersect[i] * 1e-6 << ", " << seconds_render[i]
+                  << ", " << gemspt::relative_mse(images[i], images[1]) << std::endl;
+    }
+
+    return 0;
+}
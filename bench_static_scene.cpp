@@ -0,0 +1,93 @@
+﻿#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
+#include "render.h"
+#include "static_scene.h"
+#include "bench_util.h"
+
+// 組み込みシーンについて、実行時のSceneとコンパイル時に配置を展開したStaticSceneの速度を比較する。
+// 交差判定だけの速度（箱の中からランダムな方向に飛ばしたレイ）と、レンダリング全体の時間を計る。
+// 二つは同じ結果になるはずなので、交差距離と画像の差も出力する。
+//
+// usage: bench_static_scene [レイの数] [幅] [高さ] [サブピクセルごとのサンプリング数]
+
+namespace {
+
+// raysそれぞれの交差距離をdistancesに書き込み、かかった時間を返す。
+template <typename SceneType>
+double intersect_rays(const SceneType &scene, const std::vector<gemspt::Ray> &rays, std::vector<double> *distances) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int n = (int)rays.size();
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; ++i) {
+        gemspt::Hitpoint hitpoint;
+        scene.intersect(rays[i], &hitpoint);
+        (*distances)[i] = hitpoint.distance;
+    }
+    return gemspt::elapsed_seconds(start);
+}
+
+}
+
+int main(int argc, char **argv) {
+    const int num_ray    = argc > 1 ? atoi(argv[1]) : 10000000;
+    const int width      = argc > 2 ? atoi(argv[2]) : 160;
+    const int height     = argc > 3 ? atoi(argv[3]) : 120;
+    const int num_sample = argc > 4 ? atoi(argv[4]) : 4;
+    const int num_subpixel = 2;
+
+    // 箱の中からランダムな方向に飛ばすレイ。
+    std::vector<gemspt::Ray> rays;
+    gemspt::Random random(1234);
+    for (int i = 0; i < num_ray; ++i) {
+        const gemspt::Vec org(random.next(-2.9, 8.9), random.next(0.1, 3.9), random.next(-2.9, 8.9));
+        const double z = random.next(-1.0, 1.0);
+        const double phi = random.next(0.0, 2.0 * gemspt::kPI);
+        const double r = sqrt(1.0 - z * z);
+        rays.push_back(gemspt::Ray(org, gemspt::Vec(r * cos(phi), r * sin(phi), z)));
+    }
+
+    const gemspt::BuiltinScene types[] = { gemspt::kSceneDiffuseOnly, gemspt::kSceneSpecular, gemspt::kSceneGlass };
+    const char *names[] = { "diffuse only", "specular", "glass" };
+    std::cout << "scene, method, intersect Mrays/s, render seconds" << std::endl;
+    for (int i = 0; i < 3; ++i) {
+        gemspt::Scene scene;
+        gemspt::setup_builtin_scene(&scene, types[i]);
+        const gemspt::Material *plane_materials[gemspt::StaticBuiltinScene::kNumPlanes];
+        const gemspt::Material *sphere_materials[gemspt::StaticBuiltinScene::kNumSpheres];
+        gemspt::create_builtin_materials(types[i], plane_materials, sphere_materials);
+        const gemspt::StaticScene<gemspt::StaticBuiltinScene> static_scene(plane_materials, sphere_materials);
+
+        std::vector<double> distances(num_ray), static_distances(num_ray);
+        const double seconds_intersect = intersect_rays(scene, rays, &distances);
+        const double seconds_static_intersect = intersect_rays(static_scene, rays, &static_distances);
+
+        std::vector<gemspt::Color> image(width * height), static_image(width * height);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        gemspt::render_image(scene, width, height, num_sample, num_subpixel, 1, false, &image[0]);
+        const double seconds_render = gemspt::elapsed_seconds(start);
+        start = std::chrono::steady_clock::now();
+        gemspt::render_image(static_scene, width, height, num_sample, num_subpixel, 1, false, &static_image[0]);
+        const double seconds_static_render = gemspt::elapsed_seconds(start);
+
+        std::cout << names[i] << ", runtime, " << num_ray / seconds_intersect * 1e-6 << ", " << seconds_render << std::endl;
+        std::cout << names[i] << ", static, " << num_ray / seconds_static_intersect * 1e-6 << ", " << seconds_static_render << std::endl;
+
+        // 二つのシーンで結果が一致するか。
+        int num_mismatch = 0;
+        for (int j = 0; j < num_ray; ++j) {
+            if (distances[j] != static_distances[j])
+                ++num_mismatch;
+        }
+        double max_difference = 0.0;
+        for (int j = 0; j < width * height; ++j) {
+            const gemspt::Color diff = image[j] - static_image[j];
+            max_difference = std::max(max_difference, std::max(fabs(diff.x), std::max(fabs(diff.y), fabs(diff.z))));
+        }
+        std::cout << names[i] << ", mismatched rays " << num_mismatch << ", max pixel difference " << max_difference << std::endl;
+    }
+
+    return 0;
+}
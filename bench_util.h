@@ -0,0 +1,66 @@
+﻿#ifndef _BENCH_UTIL_H_
+#define _BENCH_UTIL_H_
+
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+#include "material.h"
+
+namespace gemspt {
+
+// ベンチマークで共通に使う時間の計測と画像の誤差。
+// どのベンチマークも同じ方法で誤差を測るよう、誤差の計算はここにまとめておく。
+
+inline double elapsed_seconds(const std::chrono::steady_clock::time_point &start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// imageのreferenceに対するRMSE。RGBの各成分を一つの値として平均する。
+inline double rmse(const std::vector<Color> &image, const std::vector<Color> &reference) {
+    double sum = 0.0;
+    for (size_t i = 0; i < image.size(); ++i) {
+        const Color diff = image[i] - reference[i];
+        sum += dot(diff, diff);
+    }
+    return sqrt(sum / (image.size() * 3));
+}
+
+// imageとreferenceの差の二乗を、denominatorの二乗で割った値の平均（相対MSE）。
+// 暗い画素で発散しないよう分母に小さな値を足す。
+inline double relative_mse(const std::vector<Color> &image, const std::vector<Color> &reference, const std::vector<Color> &denominator) {
+    const double kEPS = 1e-2;
+    double sum = 0.0;
+    for (size_t i = 0; i < image.size(); ++i) {
+        const double c[3] = {image[i].x, image[i].y, image[i].z};
+        const double r[3] = {reference[i].x, reference[i].y, reference[i].z};
+        const double d[3] = {denominator[i].x, denominator[i].y, denominator[i].z};
+        for (int k = 0; k < 3; ++k)
+            sum += (c[k] - r[k]) * (c[k] - r[k]) / (d[k] * d[k] + kEPS);
+    }
+    return sum / (image.size() * 3);
+}
+
+// imageのreferenceに対する相対MSE。
+inline double relative_mse(const std::vector<Color> &image, const std::vector<Color> &reference) {
+    return relative_mse(image, reference, reference);
+}
+
+// 同じ条件で独立な乱数列でレンダリングした二枚a, bから、一枚あたりの相対MSE（分散）を見積もる。
+// E[(A - B)^2] = 2 Var なので、差の相対MSEの半分になる。分母には二枚の平均を使う。
+inline double estimate_relative_mse(const std::vector<Color> &a, const std::vector<Color> &b) {
+    std::vector<Color> mean(a.size());
+    for (size_t i = 0; i < a.size(); ++i)
+        mean[i] = (a[i] + b[i]) * 0.5;
+    return 0.5 * relative_mse(a, b, mean);
+}
+
+// 効率（1 / (相対MSE * 時間)）。大きいほど単位時間あたりのノイズが少ない。
+// 分散はサンプル数に反比例するので、サンプル数によらず手法ごとにほぼ一定になり、異なる手法やサンプル数の結果を比べられる。
+inline double efficiency(const double relative_mse, const double seconds) {
+    return 1.0 / (relative_mse * seconds);
+}
+
+};
+
+#endif
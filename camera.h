@@ -0,0 +1,56 @@
+﻿#ifndef _CAMERA_H_
+#define _CAMERA_H_
+
+#include "vec.h"
+#include "ray.h"
+
+namespace gemspt {
+
+// ピンホールカメラ
+class Camera {
+private:
+    Vec position_;
+    Vec sensor_center_;
+    Vec sensor_x_vec_, sensor_y_vec_;
+    int width_, height_;
+public:
+    Camera(const Vec &position, const Vec &lookat, const Vec &up, const int width, const int height) :
+      position_(position), width_(width), height_(height) {
+        const Vec dir = normalize(lookat - position);
+
+        // ワールド座標系でのイメージセンサーの大きさ。
+        const double sensor_width = 30.0 * width / height; // アスペクト比調整。
+        const double sensor_height= 30.0;
+        // イメージセンサーまでの距離。
+        const double sensor_dist  = 45.0;
+        // イメージセンサーを張るベクトル。
+        sensor_x_vec_ = normalize(cross(dir, up)) * sensor_width;
+        sensor_y_vec_ = normalize(cross(sensor_x_vec_, dir)) * sensor_height;
+        sensor_center_ = position + dir * sensor_dist;
+    }
+
+    const Vec& position() const {
+        return position_;
+    }
+
+    // イメージセンサー上の位置(x, y)（ピクセル単位）を通るレイを得る。
+    Ray generate_ray(const double x, const double y) const {
+        // イメージセンサー上の位置。
+        const Vec position_on_sensor = 
+            sensor_center_ + 
+            sensor_x_vec_ * (x / width_ - 0.5) +
+            sensor_y_vec_ * (y / height_- 0.5);
+        // レイを飛ばす方向。
+        const Vec dir = normalize(position_on_sensor - position_);
+        return Ray(position_, dir);
+    }
+};
+
+// 組み込みシーン用のカメラ。
+inline Camera default_camera(const int width, const int height) {
+    return Camera(Vec(7.0, 3.0, 7.0), Vec(0.0, 1.0, 0.0), Vec(0.0, 1.0, 0.0), width, height);
+}
+
+};
+
+#endif
@@ -0,0 +1,418 @@
+﻿#ifndef _GUIDING_H_
+#define _GUIDING_H_
+
+#include <vector>
+#include <algorithm>
+
+#include "vec.h"
+#include "random.h"
+#include "constant.h"
+
+namespace gemspt {
+
+// パスガイディング
+// 空間を二分木（S-tree）で分割し、各葉に入射放射輝度の方向分布を表す四分木（D-tree）を持たせる。
+// パスを追跡しながら入射放射輝度を記録して学習し、次のパスではその分布に従って反射方向をサンプリングする。
+// ガイディングの分布とBRDFのどちらからサンプリングするかの割合も、D-treeごとに推定値の分散が小さくなるよう学習する。
+// Müller et al. Practical Path Guiding for Efficient Light-Transport Simulation. EGSR 2017.
+
+// 方向の四分木
+// 方向はcylindrical mapping（等面積）で[0,1]^2に写し、その正方形を四分木で再帰的に分割する。
+// 各ノードは四つの子領域それぞれのエネルギーの和を持つ。
+class DTree {
+public:
+    // ガイディングの分布からサンプリングする割合の候補の数。候補は(i + 0.5) / kNumFraction。
+    // BRDFからのサンプリングを必ず混ぜるよう、0と1は候補に含めない。
+    static const int kNumFraction = 5;
+private:
+    struct Node {
+        double sum[4];
+        int child[4]; // 子が無ければ-1
+
+        Node() {
+            for (int i = 0; i < 4; ++i) {
+                sum[i] = 0.0;
+                child[i] = -1;
+            }
+        }
+
+        double total() const {
+            return sum[0] + sum[1] + sum[2] + sum[3];
+        }
+    };
+
+    std::vector<Node> nodes_;
+    double fraction_;               // ガイディングの分布からサンプリングする割合
+    double moments_[kNumFraction];  // 割合の候補ごとの、推定値の二乗の和
+
+    // 点(u, v)が正方形[ox, ox + size)x[oy, oy + size)のどの子領域に入るか。子領域に合わせてox, oyも更新する。
+    static int quadrant(const double u, const double v, double *ox, double *oy, const double size) {
+        const double half = size * 0.5;
+        int q = 0;
+        if (u >= *ox + half) {
+            q |= 1;
+            *ox += half;
+        }
+        if (v >= *oy + half) {
+            q |= 2;
+            *oy += half;
+        }
+        return q;
+    }
+
+    // 前回の木prevのノードprev_indexを元に新しいノードを作る。prevに対応するノードが無ければprev_indexは-1で、
+    // そのときは親の領域のエネルギーenergyが四つの子領域に均等に分布していたとみなす。
+    int refine_node(const DTree &prev, const int prev_index, const double energy, const double total, const double threshold, const int depth, const int max_depth) {
+        const int node_index = (int)nodes_.size();
+        nodes_.push_back(Node());
+        for (int q = 0; q < 4; ++q) {
+            const double child_energy = prev_index >= 0 ? prev.nodes_[prev_index].sum[q] : energy * 0.25;
+            const int prev_child = prev_index >= 0 ? prev.nodes_[prev_index].child[q] : -1;
+            // エネルギーの割合が閾値を超える領域だけを細かくする。
+            if (depth < max_depth && child_energy / total > threshold) {
+                const int child = refine_node(prev, prev_child, child_energy, total, threshold, depth + 1, max_depth);
+                nodes_[node_index].child[q] = child;
+            }
+        }
+        return node_index;
+    }
+
+public:
+    // 学習の始めは分布が粗いので、割合は最小の候補から始める。
+    DTree() : nodes_(1), fraction_(fraction_candidate(0)) {
+        for (int i = 0; i < kNumFraction; ++i)
+            moments_[i] = 0.0;
+    }
+
+    static double fraction_candidate(const int i) {
+        return (i + 0.5) / kNumFraction;
+    }
+
+    // 反射方向をガイディングの分布からサンプリングする割合。残りはBRDFからサンプリングする。
+    double fraction() const {
+        return fraction_;
+    }
+
+    double total_energy() const {
+        return nodes_[0].total();
+    }
+
+    // [0,1]^2上の点(u, v)にエネルギーvalueを加える。複数スレッドから同時に呼んでよい。
+    void record(const double u, const double v, const double value) {
+        double ox = 0.0, oy = 0.0, size = 1.0;
+        int index = 0;
+        while (index >= 0) {
+            const int q = quadrant(u, v, &ox, &oy, size);
+            double &sum = nodes_[index].sum[q];
+#pragma omp atomic
+            sum += value;
+            size *= 0.5;
+            index = nodes_[index].child[q];
+        }
+    }
+
+    // エネルギーに比例して[0,1]^2上の点をサンプリングする。pdfは[0,1]^2上の密度。
+    // 子領域の選択には一つの乱数を使い回す。選んだ子領域の中での位置を[0,1)に引き伸ばして次の深さで使う。
+    void sample(Random &random, double *u, double *v, double *pdf) const {
+        double ox = 0.0, oy = 0.0, size = 1.0;
+        double p = 1.0;
+        double r = random.next01();
+        int index = 0;
+        while (index >= 0) {
+            const Node &node = nodes_[index];
+            const double total = node.total();
+            if (total <= 0.0)
+                break;
+
+            // エネルギーに比例して子領域を選ぶ。
+            const double target = r * total;
+            int q = 0;
+            double accumulated = 0.0;
+            while (q < 3 && (target >= accumulated + node.sum[q] || node.sum[q] <= 0.0)) {
+                accumulated += node.sum[q];
+                ++q;
+            }
+            // 丸め誤差でエネルギー0の領域を選んでしまった場合。
+            while (node.sum[q] <= 0.0) {
+                --q;
+                accumulated -= node.sum[q];
+            }
+            r = std::min(std::max((target - accumulated) / node.sum[q], 0.0), 1.0 - 1e-12);
+
+            p *= 4.0 * node.sum[q] / total;
+            size *= 0.5;
+            ox += (q & 1) ? size : 0.0;
+            oy += (q & 2) ? size : 0.0;
+            index = node.child[q];
+        }
+
+        // 葉の中では一様。
+        *u = ox + random.next01() * size;
+        *v = oy + random.next01() * size;
+        *pdf = p;
+    }
+
+    // sample()で点(u, v)がサンプリングされるときのpdf。
+    double pdf(const double u, const double v) const {
+        double ox = 0.0, oy = 0.0, size = 1.0;
+        double p = 1.0;
+        int index = 0;
+        while (index >= 0) {
+            const Node &node = nodes_[index];
+            const double total = node.total();
+            if (total <= 0.0)
+                break;
+
+            const int q = quadrant(u, v, &ox, &oy, size);
+            p *= 4.0 * node.sum[q] / total;
+            size *= 0.5;
+            index = node.child[q];
+        }
+        return p;
+    }
+
+    // 学習したエネルギー分布に合わせて木の構造を作り直し、エネルギーを0にする。
+    void refine(const double threshold, const int max_depth) {
+        const DTree prev = *this;
+        const double total = prev.total_energy();
+        nodes_.clear();
+        if (total <= 0.0) {
+            nodes_.push_back(Node());
+            return;
+        }
+        refine_node(prev, 0, total, total, threshold, 1, max_depth);
+    }
+
+    // 方向と[0,1]^2上の点の変換（cylindrical mapping）。ヤコビアンは4π。
+    static void direction_to_square(const Vec &dir, double *u, double *v) {
+        const double cos_theta = std::min(std::max(dir.z, -1.0), 1.0);
+        double phi = atan2(dir.y, dir.x);
+        if (phi < 0.0)
+            phi += 2.0 * kPI;
+        *u = std::min((cos_theta + 1.0) * 0.5, 1.0 - 1e-12);
+        *v = std::min(phi / (2.0 * kPI), 1.0 - 1e-12);
+    }
+
+    static Vec square_to_direction(const double u, const double v) {
+        const double cos_theta = 2.0 * u - 1.0;
+        const double sin_theta = sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta));
+        const double phi = 2.0 * kPI * v;
+        return Vec(sin_theta * cos(phi), sin_theta * sin(phi), cos_theta);
+    }
+
+    // normalの側の半球の方向をサンプリングする。pdfは立体角測度。
+    // 分布は球面全体で学習するので、裏側の半球に出た方向は接平面で折り返して表側に集める。
+    // 折り返しは立体角を保つので、pdfは方向とその鏡像での密度の和になる。
+    Vec sample_direction(Random &random, const Vec &normal, double *pdf) const {
+        double u, v, square_pdf;
+        sample(random, &u, &v, &square_pdf);
+        const Vec dir = square_to_direction(u, v);
+        const Vec mirror_dir = reflect(dir, normal);
+        double mirror_u, mirror_v;
+        direction_to_square(mirror_dir, &mirror_u, &mirror_v);
+        *pdf = (square_pdf + this->pdf(mirror_u, mirror_v)) / (4.0 * kPI);
+        return dot(dir, normal) < 0.0 ? mirror_dir : dir;
+    }
+
+    double pdf_direction(const Vec &dir, const Vec &normal) const {
+        if (dot(dir, normal) < 0.0)
+            return 0.0;
+        double u, v, mirror_u, mirror_v;
+        direction_to_square(dir, &u, &v);
+        direction_to_square(reflect(dir, normal), &mirror_u, &mirror_v);
+        return (pdf(u, v) + pdf(mirror_u, mirror_v)) / (4.0 * kPI);
+    }
+
+    void record_direction(const Vec &dir, const double value) {
+        double u, v;
+        direction_to_square(dir, &u, &v);
+        record(u, v, value);
+    }
+
+    // 割合fractionの混合分布でサンプリングした方向についての記録。複数スレッドから同時に呼んでよい。
+    // contributionはpdfで割る前の寄与（BRDF * 入射放射輝度 * cos）、guide_pdf, brdf_pdfはその方向での各分布のpdf。
+    // 割合の候補aごとに、推定値の二乗の期待値 E_a[(contribution / pdf_a)^2] = E[contribution^2 / (pdf_a * pdf)] を見積もる。
+    void record_fraction(const double contribution, const double guide_pdf, const double brdf_pdf, const double fraction) {
+        const double pdf = fraction * guide_pdf + (1.0 - fraction) * brdf_pdf;
+        if (!(contribution > 0.0) || !(pdf > 0.0))
+            return;
+        for (int i = 0; i < kNumFraction; ++i) {
+            const double candidate = fraction_candidate(i);
+            const double candidate_pdf = candidate * guide_pdf + (1.0 - candidate) * brdf_pdf;
+            double &moment = moments_[i];
+#pragma omp atomic
+            moment += contribution * contribution / (candidate_pdf * pdf);
+        }
+    }
+
+    // 記録から推定値の二乗の期待値が最小になる割合を選び、記録を0にする。記録が無ければ割合は変えない。
+    void update_fraction() {
+        int best = -1;
+        for (int i = 0; i < kNumFraction; ++i) {
+            if (moments_[i] > 0.0 && (best < 0 || moments_[i] < moments_[best]))
+                best = i;
+        }
+        if (best >= 0)
+            fraction_ = fraction_candidate(best);
+        for (int i = 0; i < kNumFraction; ++i)
+            moments_[i] = 0.0;
+    }
+};
+
+// 空間の二分木とその葉ごとのD-tree。
+// ノードは親の領域を中点で二分割し、分割軸は深さごとにx, y, zの順に巡回させる。
+class SDTree {
+private:
+    struct Node {
+        int child[2]; // 葉なら-1
+        int leaf;     // 葉のとき、dtrees_とcounts_の番号
+        int depth;
+
+        Node(const int leaf, const int depth) : leaf(leaf), depth(depth) {
+            child[0] = child[1] = -1;
+        }
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<DTree> dtrees_;
+    std::vector<int> counts_; // 葉ごとの記録数
+    Vec bound_min_, bound_max_;
+
+public:
+    SDTree(const Vec &bound_min, const Vec &bound_max) :
+      bound_min_(bound_min), bound_max_(bound_max) {
+        nodes_.push_back(Node(0, 0));
+        dtrees_.push_back(DTree());
+        counts_.push_back(0);
+    }
+
+    // positionを含む葉の番号。境界の外の点は最も近い葉に入れる。
+    int find_leaf(const Vec &position) const {
+        Vec lower = bound_min_, upper = bound_max_;
+        int index = 0;
+        while (nodes_[index].leaf < 0) {
+            const int axis = nodes_[index].depth % 3;
+            const double mid = 0.5 * (component(lower, axis) + component(upper, axis));
+            const bool right = component(position, axis) >= mid;
+            if (axis == 0) (right ? lower.x : upper.x) = mid;
+            if (axis == 1) (right ? lower.y : upper.y) = mid;
+            if (axis == 2) (right ? lower.z : upper.z) = mid;
+            index = nodes_[index].child[right ? 1 : 0];
+        }
+        return nodes_[index].leaf;
+    }
+
+    const DTree& dtree(const int leaf) const {
+        return dtrees_[leaf];
+    }
+
+    // 複数スレッドから同時に呼んでよい。
+    void record(const Vec &position, const Vec &dir, const double value) {
+        const int leaf = find_leaf(position);
+        dtrees_[leaf].record_direction(dir, value);
+        int &count = counts_[leaf];
+#pragma omp atomic
+        count += 1;
+    }
+
+    // 複数スレッドから同時に呼んでよい。
+    void record_fraction(const Vec &position, const double contribution, const double guide_pdf, const double brdf_pdf, const double fraction) {
+        dtrees_[find_leaf(position)].record_fraction(contribution, guide_pdf, brdf_pdf, fraction);
+    }
+
+    void update_fractions() {
+        for (size_t i = 0; i < dtrees_.size(); ++i)
+            dtrees_[i].update_fraction();
+    }
+
+    // 記録数がmax_countを超える葉を分割し、各D-treeの構造を学習したエネルギー分布に合わせて作り直す。
+    void refine(const int max_count, const double dtree_threshold, const int dtree_max_depth) {
+        const int kMaxDepth = 48;
+        // 追加されたノードもこのループで処理されるので、記録数がmax_count以下になるまで分割が繰り返される。
+        for (int i = 0; i < (int)nodes_.size(); ++i) {
+            const int leaf = nodes_[i].leaf;
+            if (leaf < 0 || counts_[leaf] <= max_count || nodes_[i].depth >= kMaxDepth)
+                continue;
+
+            // 子は親のD-treeを引き継ぎ、記録数は半分ずつとみなす。
+            const int new_leaf = (int)dtrees_.size();
+            dtrees_.push_back(dtrees_[leaf]);
+            counts_[leaf] /= 2;
+            counts_.push_back(counts_[leaf]);
+
+            const int depth = nodes_[i].depth + 1;
+            nodes_[i].leaf = -1;
+            nodes_[i].child[0] = (int)nodes_.size();
+            nodes_.push_back(Node(leaf, depth));
+            nodes_[i].child[1] = (int)nodes_.size();
+            nodes_.push_back(Node(new_leaf, depth));
+        }
+
+        for (size_t i = 0; i < dtrees_.size(); ++i) {
+            dtrees_[i].refine(dtree_threshold, dtree_max_depth);
+            counts_[i] = 0;
+        }
+    }
+};
+
+// パスガイディングの学習とサンプリングを管理する。
+// 学習中のSD-treeに記録しつつ、前回の学習結果のSD-treeからサンプリングする。
+// next_iteration()で学習結果をサンプリング側に移し、学習側の木を細分化する。
+class PathGuiding {
+private:
+    SDTree sampling_;
+    SDTree building_;
+    bool has_sampling_;
+    bool training_;
+    int iteration_;
+public:
+    PathGuiding(const Vec &bound_min, const Vec &bound_max) :
+      sampling_(bound_min, bound_max), building_(bound_min, bound_max),
+      has_sampling_(false), training_(true), iteration_(0) {}
+
+    void set_training(const bool training) {
+        training_ = training;
+    }
+
+    // positionにおける学習済みの方向分布。まだ使える分布が無ければNULL。
+    const DTree* sampling_distribution(const Vec &position) const {
+        if (!has_sampling_)
+            return NULL;
+        const DTree &dtree = sampling_.dtree(sampling_.find_leaf(position));
+        if (dtree.total_energy() <= 0.0)
+            return NULL;
+        return &dtree;
+    }
+
+    // positionに方向dirから入射する放射輝度の推定値valueを記録する。
+    void record(const Vec &position, const Vec &dir, const double value) {
+        if (!training_ || !(value > 0.0))
+            return;
+        building_.record(position, dir, value);
+    }
+
+    // positionでサンプリングの割合を学習するための記録。引数はDTree::record_fraction()と同じ。
+    void record_fraction(const Vec &position, const double contribution, const double guide_pdf, const double brdf_pdf, const double fraction) {
+        if (!training_)
+            return;
+        building_.record_fraction(position, contribution, guide_pdf, brdf_pdf, fraction);
+    }
+
+    void next_iteration() {
+        // Müllerらに倣い、空間の分割はc * sqrt(2^k)個の記録を目安にする（kは学習の回数）。
+        const double kSpatialThreshold = 12000.0;
+        const double kDirectionalThreshold = 0.01;
+        const int kDirectionalMaxDepth = 20;
+
+        // 割合は細分化で引き継がれるよう、学習側の木で更新してからサンプリング側に移す。
+        building_.update_fractions();
+        sampling_ = building_;
+        has_sampling_ = true;
+        building_.refine((int)(kSpatialThreshold * sqrt(pow(2.0, iteration_))), kDirectionalThreshold, kDirectionalMaxDepth);
+        ++iteration_;
+    }
+};
+
+};
+
+#endif
@@ -0,0 +1,186 @@
+﻿#ifndef _LIGHT_TREE_H_
+#define _LIGHT_TREE_H_
+
+#include <vector>
+#include <algorithm>
+
+#include "vec.h"
+#include "random.h"
+#include "constant.h"
+
+namespace gemspt {
+
+// 多数の光源から、シェーディング点への寄与の見積もりに比例した確率で一つを選ぶための二分木。
+// 各ノードは子孫の光源の合計パワーとバウンディングボックスを持つ。
+// 根から葉に向かって、見積もった寄与に比例する確率で子を選んでいくため、選択はO(log N)になる。
+// Estevez and Kulla. Importance Sampling of Many Lights with Adaptive Tree Splitting. HPG 2018.
+class LightTree {
+public:
+    struct Light {
+        Vec position;
+        double radius;
+        double power;
+
+        Light(const Vec &position, const double radius, const double power) :
+          position(position), radius(radius), power(power) {}
+    };
+
+private:
+    struct Node {
+        Vec bound_min, bound_max;
+        double power;
+        int child[2]; // 葉なら-1
+        int parent;
+        int light;    // 葉のとき、対応する光源の番号
+
+        Node() : power(0.0), parent(-1), light(-1) {
+            child[0] = child[1] = -1;
+        }
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<int> leaf_of_light_;
+
+    // 光源番号の配列indices[begin, end)から部分木を作り、そのノード番号を返す。
+    int build_node(const std::vector<Light> &lights, std::vector<int> &indices, const int begin, const int end, const int parent) {
+        const int node_index = (int)nodes_.size();
+        nodes_.push_back(Node());
+
+        Vec bound_min(kINF, kINF, kINF), bound_max(-kINF, -kINF, -kINF);
+        Vec centroid_min(kINF, kINF, kINF), centroid_max(-kINF, -kINF, -kINF);
+        double power = 0.0;
+        for (int i = begin; i < end; ++i) {
+            const Light &light = lights[indices[i]];
+            const Vec r(light.radius, light.radius, light.radius);
+            bound_min = component_min(bound_min, light.position - r);
+            bound_max = component_max(bound_max, light.position + r);
+            centroid_min = component_min(centroid_min, light.position);
+            centroid_max = component_max(centroid_max, light.position);
+            power += light.power;
+        }
+        nodes_[node_index].bound_min = bound_min;
+        nodes_[node_index].bound_max = bound_max;
+        nodes_[node_index].power = power;
+        nodes_[node_index].parent = parent;
+
+        if (end - begin == 1) {
+            nodes_[node_index].light = indices[begin];
+            leaf_of_light_[indices[begin]] = node_index;
+            return node_index;
+        }
+
+        // 光源の中心位置が最も広がっている軸の中央値で二分割する。
+        const Vec extent = centroid_max - centroid_min;
+        int axis = 0;
+        if (extent.y > extent.x && extent.y >= extent.z)
+            axis = 1;
+        else if (extent.z > extent.x && extent.z > extent.y)
+            axis = 2;
+
+        const int mid = (begin + end) / 2;
+        std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, AxisLess(lights, axis));
+
+        const int left = build_node(lights, indices, begin, mid, node_index);
+        const int right = build_node(lights, indices, mid, end, node_index);
+        nodes_[node_index].child[0] = left;
+        nodes_[node_index].child[1] = right;
+        return node_index;
+    }
+
+    struct AxisLess {
+        const std::vector<Light> &lights;
+        const int axis;
+        AxisLess(const std::vector<Light> &lights, const int axis) : lights(lights), axis(axis) {}
+        bool operator()(const int a, const int b) const {
+            return component(lights[a].position, axis) < component(lights[b].position, axis);
+        }
+    };
+
+    // ノード以下の光源が点position（法線normal）に与える寄与の見積もり。
+    // バウンディングボックス全体が接平面より下にあるなら寄与は0。
+    double importance(const Node &node, const Vec &position, const Vec &normal) const {
+        const Vec center = (node.bound_min + node.bound_max) * 0.5;
+        const Vec half = (node.bound_max - node.bound_min) * 0.5;
+        const Vec to_center = center - position;
+
+        const double max_height = dot(to_center, normal) + fabs(normal.x) * half.x + fabs(normal.y) * half.y + fabs(normal.z) * half.z;
+        if (max_height <= 0.0)
+            return 0.0;
+
+        // ボックス内部の点に対して発散しないよう、距離の二乗はボックスの大きさで下から抑える。
+        const double distance_squared = std::max(to_center.length_squared(), half.length_squared());
+        return node.power / distance_squared;
+    }
+
+public:
+    LightTree() {}
+
+    void build(const std::vector<Light> &lights) {
+        nodes_.clear();
+        leaf_of_light_.assign(lights.size(), -1);
+        if (lights.empty())
+            return;
+
+        std::vector<int> indices(lights.size());
+        for (int i = 0; i < (int)lights.size(); ++i)
+            indices[i] = i;
+        nodes_.reserve(2 * lights.size() - 1);
+        build_node(lights, indices, 0, (int)lights.size(), -1);
+    }
+
+    // 光源を一つ選び、その番号を返す。選べる光源が無ければ-1を返す。
+    // pdfには選択確率が入る。
+    int sample(Random &random, const Vec &position, const Vec &normal, double *pdf) const {
+        if (nodes_.empty())
+            return -1;
+
+        double p = 1.0;
+        int node_index = 0;
+        while (nodes_[node_index].light < 0) {
+            const Node &node = nodes_[node_index];
+            const double left = importance(nodes_[node.child[0]], position, normal);
+            const double right = importance(nodes_[node.child[1]], position, normal);
+            const double total = left + right;
+            if (total <= 0.0)
+                return -1;
+
+            const double probability_left = left / total;
+            if (right <= 0.0 || (left > 0.0 && random.next01() < probability_left)) {
+                p *= probability_left;
+                node_index = node.child[0];
+            } else {
+                p *= 1.0 - probability_left;
+                node_index = node.child[1];
+            }
+        }
+
+        *pdf = p;
+        return nodes_[node_index].light;
+    }
+
+    // 点position（法線normal）においてsample()が光源lightを選ぶ確率。
+    // 葉から根に向かって各分岐の確率を掛け合わせる。
+    double pdf(const int light, const Vec &position, const Vec &normal) const {
+        if (light < 0 || light >= (int)leaf_of_light_.size())
+            return 0.0;
+
+        double p = 1.0;
+        int node_index = leaf_of_light_[light];
+        while (nodes_[node_index].parent >= 0) {
+            const Node &parent = nodes_[nodes_[node_index].parent];
+            const double left = importance(nodes_[parent.child[0]], position, normal);
+            const double right = importance(nodes_[parent.child[1]], position, normal);
+            const double total = left + right;
+            if (total <= 0.0)
+                return 0.0;
+
+            p *= (parent.child[0] == node_index ? left : right) / total;
+            node_index = nodes_[node_index].parent;
+        }
+        return p;
+    }
+};
+
+};
+
+#endif
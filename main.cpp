@@ -1,15 +1,60 @@
 ﻿#include <iostream>
 #include "render.h"
+#include "sppm.h"
+#include "preview.h"
+
+// パスガイディングを使う場合
+// #define USE_PATH_GUIDING
+// Stochastic Progressive Photon Mappingを使う場合
+// #define USE_SPPM
+// マテリアル調整用のプレビューを使う場合（materials.txtを書き換えるとマテリアルが反映される）
+// #define USE_PREVIEW
 
 int main() {
     std::cout << "gemspt 2015" << std::endl;
 
+    gemspt::Scene scene;
+    gemspt::setup_builtin_scene(&scene);
+
+#if defined(USE_SPPM)
+    gemspt::render_sppm(
+        "image.ppm", // 保存ファイル名
+        scene, // シーン
+        640, 480, // 解像度
+        4, // サブピクセルの縦横解像度
+        256, // パス数
+        200000, // パスあたりの光子数
+        0.05, // 光子を集める初期半径
+        8); // スレッド数
+#elif defined(USE_PREVIEW)
+    gemspt::MaterialFileEditor editor("materials.txt");
+    gemspt::render_preview(
+        "image.ppm", // 保存ファイル名
+        &scene, // シーン
+        640, 480, // 解像度
+        4, // サブピクセルの縦横解像度
+        1024, // パス数
+        5.0, // 保存する間隔（秒）
+        &editor, // マテリアルの編集
+        8); // スレッド数
+#elif defined(USE_PATH_GUIDING)
+    gemspt::render_guided(
+        "image.ppm", // 保存ファイル名
+        scene, // シーン
+        640, 480, // 解像度
+        16, // 最後のパスのサブピクセルごとのサンプリング数
+        2, // サブピクセルの縦横解像度
+        4, // ガイディングの学習パス数（サブピクセルごとに1, 2, 4, 8サンプル）
+        8); // スレッド数
+#else
     gemspt::render(
         "image.ppm", // 保存ファイル名
+        scene, // シーン
         640, 480, // 解像度
         1, // サブピクセルごとのサンプリング数
         4, // サブピクセルの縦横解像度
         8); // スレッド数
+#endif
 
     std::cout << "Done." << std::endl;
 
@@ -12,6 +12,11 @@ namespace gemspt {
 
 typedef Vec Color;
 
+// 色の明るさを表すスカラー値。簡単のためRGBの平均とする。
+inline double luminance(const Color &color) {
+    return (color.x + color.y + color.z) / 3.0;
+}
+
 // マテリアルインターフェース
 class Material {
 protected:
@@ -19,6 +24,7 @@ protected:
     Color reflectance_;
 public:
     Material(const Color &emission, const Color &reflectance) : emission_(emission), reflectance_(reflectance) {}
+    virtual ~Material() {}
     virtual Color emission() const {
         return emission_;
     }
@@ -30,6 +36,23 @@ public:
     // 以下、in = -omega, out = omega'となる。
     virtual Color eval(const Vec &in, const Vec &normal, const Vec &out) const = 0; // BRDFとして評価した時の値。
     virtual Vec sample(Random &random, const Vec &in, const Vec &normal, double *pdf, Color *brdf_value) const = 0; // 次の反射方向をサンプリング。
+    virtual double eval_pdf(const Vec &in, const Vec &normal, const Vec &out) const = 0; // sample()でoutがサンプリングされるときのpdf。
+
+    // 放射がある（光源としてふるまう）ならtrue。
+    bool is_light() const {
+        const Color e = emission();
+        return e.x > 0.0 || e.y > 0.0 || e.z > 0.0;
+    }
+
+    // BRDFがδ関数を含む（光源サンプリングが使えない）ならtrue。
+    virtual bool is_specular() const {
+        return false;
+    }
+
+    // 物体の内部に光を通す（法線の向きで内外を区別する）ならtrue。
+    virtual bool is_transmissive() const {
+        return false;
+    }
 };
 
 // Lambertian BRDF
@@ -60,6 +83,12 @@ public:
         }
         return dir;
     }
+
+    virtual double eval_pdf(const Vec &in, const Vec &normal, const Vec &out) const {
+        if (dot(normal, out) < 0)
+            return 0.0;
+        return 1.0 / (2.0 * kPI);
+    }
 };
 
 // Lambertian BRDF
@@ -91,6 +120,13 @@ public:
         }
         return dir;
     }
+
+    virtual double eval_pdf(const Vec &in, const Vec &normal, const Vec &out) const {
+        const double cost = dot(normal, out);
+        if (cost < 0)
+            return 0.0;
+        return cost / kPI;
+    }
 };
 
 // 正規化Phong BRDF
@@ -130,10 +166,7 @@ public:
         dir = tangent * sin(theta) * cos(phi) + reflection_dir * cos(theta) + binormal *sin(theta) * sin(phi);
         
         if (pdf != NULL) {
-            double cosa = dot(reflection_dir, dir);
-            if (cosa < 0)
-                cosa = 0.0;
-            *pdf = (n_ + 1.0) / (2.0 * kPI) * pow(cosa, n_);
+            *pdf = eval_pdf(in, normal, dir);
         }
         if (brdf_value != NULL) {
             *brdf_value = eval(in, normal, dir);
@@ -141,6 +174,14 @@ public:
 
         return dir;
     }
+
+    virtual double eval_pdf(const Vec &in, const Vec &normal, const Vec &out) const {
+        const Vec reflection_dir = reflect(in, normal);
+        double cosa = dot(reflection_dir, out);
+        if (cosa < 0)
+            cosa = 0.0;
+        return (n_ + 1.0) / (2.0 * kPI) * pow(cosa, n_);
+    }
 };
 
 // 理想的なガラス面。
@@ -221,6 +262,19 @@ public:
             return refraction_dir;
         }
     }
+
+    // δ関数なので、sample()以外で方向が選ばれる確率は0。
+    virtual double eval_pdf(const Vec &in, const Vec &normal, const Vec &out) const {
+        return 0.0;
+    }
+
+    virtual bool is_specular() const {
+        return true;
+    }
+
+    virtual bool is_transmissive() const {
+        return true;
+    }
 };
 #undef DELTA
 
@@ -0,0 +1,297 @@
+﻿#ifndef	_MESH_H_
+#define	_MESH_H_
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "vec.h"
+#include "ray.h"
+#include "constant.h"
+#include "hitpoint.h"
+
+namespace gemspt {
+
+// 三角形メッシュの幾何学的な情報を持つ
+// 頂点座標はx, y, zごとの配列（SoA）で持ち、三角形は頂点番号三つで表す。
+// 法線は頂点の並びから右ねじの向き（cross(v1 - v0, v2 - v0)）とする。裏側からのレイとも交差し、法線はこの向きのまま返す（裏面の扱いはSceneMeshで決める）。
+// 三角形の探索にはBVHを使う。頂点と三角形を追加し終えたらbuild()を呼ぶこと。
+class TriangleMesh {
+private:
+    struct Node {
+        Vec bound_min, bound_max;
+        int start, count; // 葉のとき、triangles_[start, start + count)の三角形を持つ。内部ノードならcountは0
+        int right;        // 内部ノードのとき右の子の番号。左の子は直後のノード
+
+        Node() : start(0), count(0), right(-1) {}
+    };
+
+    std::vector<double> x_, y_, z_;
+    std::vector<int> indices_;
+    std::vector<int> triangles_; // BVHの葉の順に並べた三角形番号
+    std::vector<Node> nodes_;
+
+    Vec vertex(const int index) const {
+        return Vec(x_[index], y_[index], z_[index]);
+    }
+
+    Vec centroid(const int triangle) const {
+        return (vertex(indices_[triangle * 3]) + vertex(indices_[triangle * 3 + 1]) + vertex(indices_[triangle * 3 + 2])) / 3.0;
+    }
+
+    struct CentroidLess {
+        const TriangleMesh &mesh;
+        const int axis;
+        CentroidLess(const TriangleMesh &mesh, const int axis) : mesh(mesh), axis(axis) {}
+        bool operator()(const int a, const int b) const {
+            return component(mesh.centroid(a), axis) < component(mesh.centroid(b), axis);
+        }
+    };
+
+    void build_node(const int begin, const int end) {
+        const int kMaxLeafSize = 4;
+        const int node_index = (int)nodes_.size();
+        nodes_.push_back(Node());
+
+        Vec bound_min(kINF, kINF, kINF), bound_max(-kINF, -kINF, -kINF);
+        Vec centroid_min(kINF, kINF, kINF), centroid_max(-kINF, -kINF, -kINF);
+        for (int i = begin; i < end; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                const Vec v = vertex(indices_[triangles_[i] * 3 + k]);
+                bound_min = component_min(bound_min, v);
+                bound_max = component_max(bound_max, v);
+            }
+            const Vec c = centroid(triangles_[i]);
+            centroid_min = component_min(centroid_min, c);
+            centroid_max = component_max(centroid_max, c);
+        }
+        nodes_[node_index].bound_min = bound_min;
+        nodes_[node_index].bound_max = bound_max;
+
+        if (end - begin <= kMaxLeafSize) {
+            nodes_[node_index].start = begin;
+            nodes_[node_index].count = end - begin;
+            return;
+        }
+
+        // 重心が最も広がっている軸の中央値で二分割する。
+        const Vec extent = centroid_max - centroid_min;
+        int axis = 0;
+        if (extent.y > extent.x && extent.y >= extent.z)
+            axis = 1;
+        else if (extent.z > extent.x && extent.z > extent.y)
+            axis = 2;
+
+        const int mid = (begin + end) / 2;
+        std::nth_element(triangles_.begin() + begin, triangles_.begin() + mid, triangles_.begin() + end, CentroidLess(*this, axis));
+
+        build_node(begin, mid);
+        nodes_[node_index].right = (int)nodes_.size();
+        build_node(mid, end);
+    }
+
+    // レイとAABBの交差判定（slab法）。[t_min, t_max]と重なればtrue。
+    // 丸め誤差で隣り合う葉の境界上のレイが両方の箱を外れないよう、各軸の遠い側の距離を(1 + 2γ3)倍して保守的に判定する。
+    // Ize. Robust BVH Ray Traversal. JCGT 2013.
+    static bool intersect_box(const Vec &bound_min, const Vec &bound_max, const Vec &org, const Vec &inv_dir, double t_min, double t_max) {
+        const double kMachineEpsilon = std::numeric_limits<double>::epsilon() * 0.5;
+        const double kGamma3 = 3.0 * kMachineEpsilon / (1.0 - 3.0 * kMachineEpsilon);
+        const double kScale = 1.0 + 2.0 * kGamma3;
+        const double tx1 = (bound_min.x - org.x) * inv_dir.x, tx2 = (bound_max.x - org.x) * inv_dir.x;
+        t_min = std::max(t_min, std::min(tx1, tx2));
+        t_max = std::min(t_max, std::max(tx1, tx2) * kScale);
+        const double ty1 = (bound_min.y - org.y) * inv_dir.y, ty2 = (bound_max.y - org.y) * inv_dir.y;
+        t_min = std::max(t_min, std::min(ty1, ty2));
+        t_max = std::min(t_max, std::max(ty1, ty2) * kScale);
+        const double tz1 = (bound_min.z - org.z) * inv_dir.z, tz2 = (bound_max.z - org.z) * inv_dir.z;
+        t_min = std::max(t_min, std::min(tz1, tz2));
+        t_max = std::min(t_max, std::max(tz1, tz2) * kScale);
+        return t_min <= t_max;
+    }
+
+public:
+    TriangleMesh() {}
+
+    int num_vertices() const {
+        return (int)x_.size();
+    }
+
+    int num_triangles() const {
+        return (int)indices_.size() / 3;
+    }
+
+    int add_vertex(const Vec &v) {
+        x_.push_back(v.x);
+        y_.push_back(v.y);
+        z_.push_back(v.z);
+        return (int)x_.size() - 1;
+    }
+
+    void add_triangle(const int v0, const int v1, const int v2) {
+        indices_.push_back(v0);
+        indices_.push_back(v1);
+        indices_.push_back(v2);
+    }
+
+    // 全頂点をscale倍してからtranslateだけ平行移動する。
+    void transform(const double scale, const Vec &translate) {
+        for (size_t i = 0; i < x_.size(); ++i) {
+            x_[i] = x_[i] * scale + translate.x;
+            y_[i] = y_[i] * scale + translate.y;
+            z_[i] = z_[i] * scale + translate.z;
+        }
+    }
+
+    void build() {
+        nodes_.clear();
+        triangles_.resize(num_triangles());
+        for (int i = 0; i < num_triangles(); ++i)
+            triangles_[i] = i;
+        if (num_triangles() > 0)
+            build_node(0, num_triangles());
+    }
+
+    // 入力のrayに対する交差点までの距離を得る。
+    // 交差したらtrue,さもなくばfalseを返す。
+    // 三角形との交差判定は、隣り合う三角形の辺の上でレイがすり抜けない（watertight）方法を使う。
+    // Woop et al. Watertight Ray/Triangle Intersection. JCGT 2013.
+    inline bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        // 自己交差の判定用定数。
+        const double kEPS = 1e-6;
+
+        if (nodes_.empty())
+            return false;
+
+        // レイの方向の絶対値が最大の軸をzとする座標系に変換し、レイの方向がz軸になるよう剪断する。
+        const double dir[3] = {ray.dir.x, ray.dir.y, ray.dir.z};
+        int kz = 0;
+        if (fabs(dir[1]) > fabs(dir[kz])) kz = 1;
+        if (fabs(dir[2]) > fabs(dir[kz])) kz = 2;
+        int kx = (kz + 1) % 3, ky = (kx + 1) % 3;
+        if (dir[kz] < 0.0)
+            std::swap(kx, ky); // 頂点の並びの向きを保つ
+        const double sx = dir[kx] / dir[kz];
+        const double sy = dir[ky] / dir[kz];
+        const double sz = 1.0 / dir[kz];
+        const double org[3] = {ray.org.x, ray.org.y, ray.org.z};
+        const Vec inv_dir(1.0 / ray.dir.x, 1.0 / ray.dir.y, 1.0 / ray.dir.z);
+
+        double nearest = kINF;
+        int hit_triangle = -1;
+
+        int stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const int node_index = stack[--stack_size];
+            const Node &node = nodes_[node_index];
+            if (!intersect_box(node.bound_min, node.bound_max, ray.org, inv_dir, kEPS, nearest))
+                continue;
+
+            if (node.count == 0) {
+                stack[stack_size++] = node.right;
+                stack[stack_size++] = node_index + 1;
+                continue;
+            }
+
+            for (int i = node.start; i < node.start + node.count; ++i) {
+                const int triangle = triangles_[i];
+                const int i0 = indices_[triangle * 3], i1 = indices_[triangle * 3 + 1], i2 = indices_[triangle * 3 + 2];
+                const double a[3] = {x_[i0] - org[0], y_[i0] - org[1], z_[i0] - org[2]};
+                const double b[3] = {x_[i1] - org[0], y_[i1] - org[1], z_[i1] - org[2]};
+                const double c[3] = {x_[i2] - org[0], y_[i2] - org[1], z_[i2] - org[2]};
+
+                const double ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+                const double bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+                const double cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+                // 辺関数。全て同じ符号ならレイは三角形の内側を通る。
+                const double u = cx * by - cy * bx;
+                const double v = ax * cy - ay * cx;
+                const double w = bx * ay - by * ax;
+                if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0))
+                    continue;
+
+                const double det = u + v + w;
+                if (det == 0.0)
+                    continue;
+
+                const double t = (u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz]) / det;
+                if (t < kEPS || t >= nearest)
+                    continue;
+
+                nearest = t;
+                hit_triangle = triangle;
+            }
+        }
+
+        if (hit_triangle < 0)
+            return false;
+
+        const Vec v0 = vertex(indices_[hit_triangle * 3]);
+        const Vec v1 = vertex(indices_[hit_triangle * 3 + 1]);
+        const Vec v2 = vertex(indices_[hit_triangle * 3 + 2]);
+        hitpoint->distance = nearest;
+        hitpoint->position = ray.org + nearest * ray.dir;
+        hitpoint->normal   = normalize(cross(v1 - v0, v2 - v0));
+        return true;
+    }
+};
+
+// Wavefront OBJファイルから頂点と面を読み込んでmeshに追加する。
+// 頂点(v)と面(f)以外は無視し、多角形の面は扇状に三角形分割する。
+// 読み込めないか、面がそれまでに読んだ頂点の範囲外を指していればfalseを返す（meshには途中まで追加されている）。
+// build()は呼ばないので、必要なら変換してから呼ぶこと。
+inline bool load_obj(const std::string &filename, TriangleMesh *mesh) {
+    FILE *f = fopen(filename.c_str(), "r");
+    if (f == NULL)
+        return false;
+
+    const int base = mesh->num_vertices();
+    int num_vertices = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == 'v' && line[1] == ' ') {
+            double x, y, z;
+            if (sscanf(line + 2, "%lf %lf %lf", &x, &y, &z) == 3) {
+                mesh->add_vertex(Vec(x, y, z));
+                ++num_vertices;
+            }
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            // "f 1 2 3", "f 1/1/1 2/2/2 3/3/3"などの形式。負の番号は末尾からの相対位置。
+            std::vector<int> face;
+            char *p = line + 2;
+            while (*p != '\0') {
+                char *end;
+                const long index = strtol(p, &end, 10);
+                if (end == p) {
+                    ++p;
+                    continue;
+                }
+                // 番号は1始まりなので0も範囲外。
+                const long local = index < 0 ? num_vertices + index : index - 1;
+                if (index == 0 || local < 0 || local >= num_vertices) {
+                    fclose(f);
+                    return false;
+                }
+                face.push_back(base + (int)local);
+                // "/"以降のテクスチャ座標・法線の番号を読み飛ばす。
+                p = end;
+                while (*p != '\0' && *p != ' ' && *p != '\t')
+                    ++p;
+            }
+            for (size_t i = 2; i < face.size(); ++i)
+                mesh->add_triangle(face[0], face[i - 1], face[i]);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+};
+
+#endif
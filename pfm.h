@@ -0,0 +1,84 @@
+﻿#ifndef _PFM_H_
+#define _PFM_H_
+
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "material.h"
+
+namespace gemspt {
+
+// PFM（Portable Float Map）形式の読み書き
+// ヘッダは"PF\n幅 高さ\nscale\n"で、scaleが負ならリトルエンディアン。画素は32bit浮動小数点数のRGBを下の行から並べる。
+// imageはsave_ppm_file()と同じく上の行から並べたwidth * height要素。
+
+inline bool is_little_endian() {
+    const unsigned int x = 1;
+    unsigned char c;
+    memcpy(&c, &x, 1);
+    return c == 1;
+}
+
+// 保存できなければfalseを返す。
+inline bool save_pfm_file(const std::string &filename, const Color *image, const int width, const int height) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (f == NULL)
+        return false;
+
+    fprintf(f, "PF\n%d %d\n%f\n", width, height, is_little_endian() ? -1.0 : 1.0);
+    std::vector<float> row(width * 3);
+    for (int y = height - 1; y >= 0; --y) {
+        for (int x = 0; x < width; ++x) {
+            const Color &c = image[y * width + x];
+            row[x * 3 + 0] = (float)c.x;
+            row[x * 3 + 1] = (float)c.y;
+            row[x * 3 + 2] = (float)c.z;
+        }
+        fwrite(&row[0], sizeof(float), row.size(), f);
+    }
+    fclose(f);
+    return true;
+}
+
+// 読み込めなければfalseを返す。RGBのPFMだけを扱う。
+inline bool load_pfm_file(const std::string &filename, std::vector<Color> *image, int *width, int *height) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (f == NULL)
+        return false;
+
+    char type[3] = {0};
+    double scale = 0.0;
+    if (fscanf(f, "%2s %d %d %lf", type, width, height, &scale) != 4 || strcmp(type, "PF") != 0 || *width <= 0 || *height <= 0) {
+        fclose(f);
+        return false;
+    }
+    fgetc(f); // scaleの後の改行一文字
+
+    // ファイルと実行環境のエンディアンが異なればバイト順を入れ替える。
+    const bool swap = (scale < 0.0) != is_little_endian();
+    image->assign(*width * *height, Color());
+    std::vector<float> row(*width * 3);
+    for (int y = *height - 1; y >= 0; --y) {
+        if (fread(&row[0], sizeof(float), row.size(), f) != row.size()) {
+            fclose(f);
+            return false;
+        }
+        for (size_t i = 0; swap && i < row.size(); ++i) {
+            unsigned char *b = (unsigned char*)&row[i];
+            std::swap(b[0], b[3]);
+            std::swap(b[1], b[2]);
+        }
+        for (int x = 0; x < *width; ++x)
+            (*image)[y * *width + x] = Color(row[x * 3 + 0], row[x * 3 + 1], row[x * 3 + 2]);
+    }
+    fclose(f);
+    return true;
+}
+
+};
+
+#endif
@@ -0,0 +1,110 @@
+﻿#ifndef _PHOTON_MAP_H_
+#define _PHOTON_MAP_H_
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "vec.h"
+#include "material.h"
+
+namespace gemspt {
+
+// 面に到達した光子
+struct Photon {
+    Vec position;
+    Vec dir;     // 光子の進行方向
+    Color power;
+
+    Photon(const Vec &position, const Vec &dir, const Color &power) :
+      position(position), dir(dir), power(power) {}
+};
+
+// 光子を格納する空間ハッシュグリッド
+// 空間を一辺cell_sizeの立方体セルに区切り、セル座標のハッシュ値ごとに光子を連続したメモリに並べておく。
+// 探索半径をcell_size以下にすれば、周囲3x3x3セルを調べるだけで半径内の光子が全て見つかる。
+class PhotonHashGrid {
+private:
+    std::vector<Photon> photons_;  // ハッシュ値の順に並べた光子
+    std::vector<int> cell_start_;  // ハッシュ値hの光子はphotons_[cell_start_[h], cell_start_[h + 1])
+    double inv_cell_size_;
+
+    void cell_of(const Vec &position, int *ix, int *iy, int *iz) const {
+        *ix = (int)floor(position.x * inv_cell_size_);
+        *iy = (int)floor(position.y * inv_cell_size_);
+        *iz = (int)floor(position.z * inv_cell_size_);
+    }
+
+    unsigned int hash(const int ix, const int iy, const int iz) const {
+        // Teschner et al. Optimized Spatial Hashing for Collision Detection of Deformable Objects. VMV 2003.
+        const unsigned int h = ((unsigned int)ix * 73856093u) ^ ((unsigned int)iy * 19349663u) ^ ((unsigned int)iz * 83492791u);
+        return h % (unsigned int)(cell_start_.size() - 1);
+    }
+
+public:
+    PhotonHashGrid() : cell_start_(2, 0), inv_cell_size_(1.0) {}
+
+    int num_photons() const {
+        return (int)photons_.size();
+    }
+
+    // 光子からグリッドを作り直す。
+    void build(const std::vector<Photon> &photons, const double cell_size) {
+        inv_cell_size_ = 1.0 / cell_size;
+        const int table_size = std::max(1, (int)photons.size() * 2);
+        cell_start_.assign(table_size + 1, 0);
+
+        // 計数ソートでハッシュ値ごとに並べる。
+        std::vector<unsigned int> hashes(photons.size());
+        for (size_t i = 0; i < photons.size(); ++i) {
+            int ix, iy, iz;
+            cell_of(photons[i].position, &ix, &iy, &iz);
+            hashes[i] = hash(ix, iy, iz);
+            ++cell_start_[hashes[i] + 1];
+        }
+        for (int h = 0; h < table_size; ++h)
+            cell_start_[h + 1] += cell_start_[h];
+
+        std::vector<int> offset(cell_start_.begin(), cell_start_.end() - 1);
+        photons_.assign(photons.size(), Photon(Vec(), Vec(), Color()));
+        for (size_t i = 0; i < photons.size(); ++i)
+            photons_[offset[hashes[i]]++] = photons[i];
+    }
+
+    // positionから半径radius以内の光子それぞれについてgather(photon)を呼ぶ。radiusはcell_size以下であること。
+    template <typename Gather>
+    void gather(const Vec &position, const double radius, Gather &gather) const {
+        if (photons_.empty())
+            return;
+
+        int cx, cy, cz;
+        cell_of(position, &cx, &cy, &cz);
+        const double radius_squared = radius * radius;
+
+        // 異なるセルが同じハッシュ値になることがあるので、同じ光子を二度数えないよう調べたハッシュ値を覚えておく。
+        unsigned int visited[27];
+        int num_visited = 0;
+        for (int dz = -1; dz <= 1; ++dz) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    const unsigned int h = hash(cx + dx, cy + dy, cz + dz);
+                    bool duplicated = false;
+                    for (int i = 0; i < num_visited; ++i)
+                        duplicated = duplicated || visited[i] == h;
+                    if (duplicated)
+                        continue;
+                    visited[num_visited++] = h;
+
+                    for (int i = cell_start_[h]; i < cell_start_[h + 1]; ++i) {
+                        if ((photons_[i].position - position).length_squared() < radius_squared)
+                            gather(photons_[i]);
+                    }
+                }
+            }
+        }
+    }
+};
+
+};
+
+#endif
@@ -0,0 +1,55 @@
+﻿#ifndef	_PLANE_H_
+#define	_PLANE_H_
+
+#include <cmath>
+
+#include "vec.h"
+#include "ray.h"
+#include "constant.h"
+#include "hitpoint.h"
+
+namespace gemspt {
+
+// 無限平面の幾何学的な情報を持つ
+// 法線の反対側は物体の内部（半空間）とみなす。
+class Plane {
+private:
+    Vec normal_;
+    double offset_; // 平面上の点pについて dot(normal_, p) = offset_
+public:
+    Plane(const Vec &normal, const Vec &position) :
+      normal_(normalize(normal)), offset_(dot(normalize(normal), position)) {}
+
+    const Vec& normal() const {
+        return normal_;
+    }
+
+    // 点pの法線方向の高さ。負なら平面の裏側。
+    double height(const Vec &p) const {
+        return dot(normal_, p) - offset_;
+    }
+
+    // 入力のrayに対する交差点までの距離を得る。
+    // 交差したらtrue,さもなくばfalseを返す。
+    inline bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        // 自己交差の判定用定数。
+        const double kEPS = 1e-6; 
+
+        const double cos_dir = dot(normal_, ray.dir);
+        if (cos_dir == 0.0)
+            return false;
+
+        const double t = -height(ray.org) / cos_dir;
+        if (t < kEPS)
+            return false;
+
+        hitpoint->distance = t;
+        hitpoint->position = ray.org + t * ray.dir;
+        hitpoint->normal   = normal_;
+        return true;
+    }
+};
+
+};
+
+#endif
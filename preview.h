@@ -0,0 +1,281 @@
+﻿#ifndef _PREVIEW_H_
+#define _PREVIEW_H_
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <chrono>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // _OPENMP
+
+#include "camera.h"
+#include "radiance.h"
+#include "scene.h"
+#include "ppm.h"
+#include "random.h"
+
+namespace gemspt {
+
+// マテリアルを調整するためのプレビュー
+// カメラからのレイの最初の交差点（G-buffer）をサブピクセルごとに保存しておき、
+// 1パスにつきサブピクセルごとに1サンプルずつ画像を足し込んでいく。
+// マテリアルだけを変更したときは、蓄積を捨てて保存した交差点からパスを追跡し直す（カメラからのレイの交差判定を省く）。
+// サブピクセルの位置はrender_image()と同じく固定なので、交差点は正確に再利用できる。
+// ただし長方形やメッシュの交差点の法線はマテリアルが光を通すかどうかで向きが変わる（SceneObject::orient_normal()）ので、
+// それが変わる編集では交差判定からやり直す。
+
+// G-bufferの一要素。
+struct GBufferSample {
+    const SceneObject *object; // 何にも当たらなければNULL
+    int material_id;
+    Hitpoint hitpoint;
+
+    GBufferSample() : object(NULL), material_id(-1), hitpoint() {}
+};
+
+class PreviewRenderer {
+private:
+    const Scene &scene_;
+    int width_, height_, num_subpixel_;
+    Camera camera_;
+    std::vector<GBufferSample> gbuffer_; // ピクセルごとにnum_subpixel * num_subpixel要素
+    std::vector<Color> accumulation_;
+    std::vector<bool> transmissive_; // G-bufferを作ったときの、マテリアルごとのis_transmissive()
+    int num_pass_;
+
+    Ray camera_ray(const int x, const int y, const int sx, const int sy) const {
+        const double rate = (1.0 / num_subpixel_);
+        const double r1 = sx * rate + rate / 2.0;
+        const double r2 = sy * rate + rate / 2.0;
+        return camera_.generate_ray(r1 + x, r2 + y);
+    }
+
+    int gbuffer_index(const int x, const int y, const int sx, const int sy) const {
+        return ((y * width_ + x) * num_subpixel_ + sy) * num_subpixel_ + sx;
+    }
+public:
+    PreviewRenderer(const Scene &scene, const int width, const int height, const int num_subpixel) :
+      scene_(scene), width_(width), height_(height), num_subpixel_(num_subpixel), camera_(default_camera(width, height)),
+      gbuffer_(width * height * num_subpixel * num_subpixel), accumulation_(width * height), num_pass_(0) {
+        update_gbuffer();
+    }
+
+    int num_pass() const {
+        return num_pass_;
+    }
+
+    // 画素(x, y)の中央のサブピクセルに見えているマテリアルの番号。何も見えなければ-1。
+    int material_id(const int x, const int y) const {
+        return gbuffer_[gbuffer_index(x, y, num_subpixel_ / 2, num_subpixel_ / 2)].material_id;
+    }
+
+    // カメラからのレイを交差判定し直してG-bufferを作り、蓄積を捨てる。物体の配置を変えたときに呼ぶ。
+    void update_gbuffer() {
+        transmissive_.resize(scene_.num_materials());
+        for (int i = 0; i < scene_.num_materials(); ++i)
+            transmissive_[i] = scene_.material(i)->is_transmissive();
+
+        for (int y = 0; y < height_; ++y) {
+#pragma omp parallel for schedule(static) // OpenMP
+            for (int x = 0; x < width_; ++x) {
+                for (int sy = 0; sy < num_subpixel_; ++sy) {
+                    for (int sx = 0; sx < num_subpixel_; ++sx) {
+                        GBufferSample &sample = gbuffer_[gbuffer_index(x, y, sx, sy)];
+                        sample.object = scene_.intersect(camera_ray(x, y, sx, sy), &sample.hitpoint);
+                        sample.material_id = sample.object != NULL ? sample.object->material_id() : -1;
+                    }
+                }
+            }
+        }
+        reset();
+    }
+
+    // マテリアルを変えたときに呼ぶ。光を通すかどうかが変わったマテリアルがあればG-bufferを作り直し、
+    // そうでなければ蓄積だけを捨てる。
+    void update_materials() {
+        for (int i = 0; i < scene_.num_materials(); ++i) {
+            if (scene_.material(i)->is_transmissive() != transmissive_[i]) {
+                update_gbuffer();
+                return;
+            }
+        }
+        reset();
+    }
+
+    // 蓄積を捨てる。
+    void reset() {
+        for (size_t i = 0; i < accumulation_.size(); ++i)
+            accumulation_[i] = Color();
+        num_pass_ = 0;
+    }
+
+    // サブピクセルごとに1サンプルずつ追跡して蓄積に足す。
+    void render_pass() {
+        for (int y = 0; y < height_; ++y) {
+#pragma omp parallel for schedule(static) // OpenMP
+            for (int x = 0; x < width_; ++x) {
+                // render_image()のseedにパス数を使ったときと同じ乱数列。
+                Random random((unsigned long long)num_pass_ * width_ * height_ + y * width_ + x + 1);
+
+                const int image_index = (height_ - y - 1) * width_ + x;
+                Color accumulated_radiance = Color();
+                for (int sy = 0; sy < num_subpixel_; ++sy) {
+                    for (int sx = 0; sx < num_subpixel_; ++sx) {
+                        const GBufferSample &sample = gbuffer_[gbuffer_index(x, y, sx, sy)];
+                        if (sample.object == NULL)
+                            continue;
+                        accumulated_radiance = accumulated_radiance +
+                            radiance_at_hitpoint(scene_, camera_ray(x, y, sx, sy), sample.hitpoint, sample.object, random, 0);
+                    }
+                }
+                accumulation_[image_index] = accumulation_[image_index] + accumulated_radiance / (double)(num_subpixel_ * num_subpixel_);
+            }
+        }
+        ++num_pass_;
+    }
+
+    // 現在の推定値をimageに書き込む。imageはwidth * height要素。
+    void get_image(Color *image) const {
+        const double scale = num_pass_ > 0 ? 1.0 / num_pass_ : 0.0;
+        for (int i = 0; i < width_ * height_; ++i)
+            image[i] = accumulation_[i] * scale;
+    }
+};
+
+// プレビュー中のマテリアルの編集。パスの合間に呼ばれる。
+class PreviewEditor {
+public:
+    virtual ~PreviewEditor() {}
+    // sceneのマテリアルを変更したらtrueを返す。
+    virtual bool edit(Scene *scene) = 0;
+};
+
+// テキストファイルに書いたマテリアルをシーンに反映する。ファイルの中身が変わったマテリアルだけを反映する。
+// 一行に一つ、"マテリアル番号 種類 r g b [パラメータ]"の形式で書く。#以降はコメント。
+// 種類はlambertian, phong（パラメータは指数、0以上）, glass（パラメータは屈折率、正）, light（r g bは放射輝度）。
+// 同じマテリアル番号の行が複数あれば最後の行を使う。
+class MaterialFileEditor : public PreviewEditor {
+private:
+    std::string filename_;
+    std::map<int, std::string> applied_; // マテリアル番号ごとに反映を試みた行
+
+    // contentからマテリアルを作る。書式が正しくなければエラーを出してNULLを返す。
+    const Material* create_material(const std::string &content) const {
+        int material_id;
+        char type[32];
+        double r, g, b, parameter;
+        const int num_field = sscanf(content.c_str(), "%d %31s %lf %lf %lf %lf", &material_id, type, &r, &g, &b, &parameter);
+        const std::string type_name = num_field >= 2 ? type : "";
+        const bool has_parameter = type_name == "phong" || type_name == "glass";
+        if (num_field < (has_parameter ? 6 : 5)) {
+            std::cerr << filename_ << ": material " << material_id << ": too few fields" << std::endl;
+            return NULL;
+        }
+
+        const Color color(r, g, b);
+        if (type_name == "lambertian")
+            return new LambertianMaterial(color);
+        if (type_name == "phong") {
+            if (parameter < 0.0) {
+                std::cerr << filename_ << ": material " << material_id << ": negative phong exponent " << parameter << std::endl;
+                return NULL;
+            }
+            return new PhongMaterial(color, parameter);
+        }
+        if (type_name == "glass") {
+            if (parameter <= 0.0) {
+                std::cerr << filename_ << ": material " << material_id << ": non-positive index of refraction " << parameter << std::endl;
+                return NULL;
+            }
+            return new GlassMaterial(color, parameter);
+        }
+        if (type_name == "light")
+            return new Lightsource(color);
+        std::cerr << filename_ << ": material " << material_id << ": unknown material type " << type_name << std::endl;
+        return NULL;
+    }
+public:
+    MaterialFileEditor(const std::string &filename) : filename_(filename) {}
+
+    virtual bool edit(Scene *scene) {
+        std::ifstream file(filename_.c_str());
+        if (!file)
+            return false;
+
+        // マテリアル番号ごとの最後の行。
+        std::map<int, std::string> contents;
+        std::string line;
+        while (std::getline(file, line)) {
+            const std::string content = line.substr(0, line.find('#'));
+            int material_id;
+            if (sscanf(content.c_str(), "%d", &material_id) == 1)
+                contents[material_id] = content;
+        }
+
+        bool changed = false;
+        for (std::map<int, std::string>::const_iterator it = contents.begin(); it != contents.end(); ++it) {
+            const int material_id = it->first;
+            if (applied_[material_id] == it->second)
+                continue;
+            // 書式が正しくなくても、同じ行について何度もエラーを出さないよう記録しておく。
+            applied_[material_id] = it->second;
+            if (material_id < 0 || material_id >= scene->num_materials()) {
+                std::cerr << filename_ << ": material " << material_id << ": out of range" << std::endl;
+                continue;
+            }
+
+            const Material *material = create_material(it->second);
+            if (material == NULL)
+                continue;
+            scene->replace_material(material_id, material);
+            changed = true;
+        }
+        return changed;
+    }
+};
+
+// プレビューしながらレンダリングする。
+// 1パスごとに蓄積し、write_interval秒ごとと最後に現在の推定値をfilenameに保存する。
+// editorがNULLでなければパスの合間に呼び、マテリアルが変わったら蓄積を捨ててやり直す。
+int render_preview(const char *filename, Scene *scene, const int width, const int height, const int num_subpixel, const int num_pass,
+                   const double write_interval, PreviewEditor *editor, const int num_thread) {
+#ifdef _OPENMP
+    omp_set_num_threads(num_thread);
+#endif // _OPENMP
+
+    if (editor != NULL)
+        editor->edit(scene);
+    PreviewRenderer renderer(*scene, width, height, num_subpixel);
+    std::vector<Color> image(width * height);
+    std::cout << width << "x" << height << " preview, " << num_subpixel * num_subpixel << " spp per pass" << std::endl;
+
+    std::chrono::steady_clock::time_point last_write = std::chrono::steady_clock::now();
+    while (renderer.num_pass() < num_pass) {
+        if (editor != NULL && editor->edit(scene)) {
+            std::cerr << std::endl << "material changed, restarting" << std::endl;
+            renderer.update_materials();
+        }
+
+        renderer.render_pass();
+        std::cerr << "Rendering (pass = " << renderer.num_pass() << ")          \r";
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - last_write).count() >= write_interval || renderer.num_pass() == num_pass) {
+            renderer.get_image(&image[0]);
+            save_ppm_file(filename, &image[0], width, height);
+            last_write = now;
+        }
+    }
+    std::cout << std::endl;
+
+    return 0;
+}
+
+};
+
+#endif
@@ -8,49 +8,162 @@
 #include "sphere.h"
 #include "hitpoint.h"
 #include "random.h"
+#include "guiding.h"
 
 namespace gemspt {
 
-// ray方向からの放射輝度を求める
-Color radiance(const Ray &ray, Random &random, const int depth) {
-    const Color kBackgroundColor = Color(0.0f, 0.0f, 0.0f);
-    const int kDepthLimit = 10;
-    // 打ち切りチェック
-    if (depth >= kDepthLimit)
+// MISのpower heuristicによる重み。
+inline double mis_weight(const double pdf_a, const double pdf_b) {
+    const double a2 = pdf_a * pdf_a;
+    const double b2 = pdf_b * pdf_b;
+    if (a2 + b2 <= 0.0)
+        return 0.0;
+    return a2 / (a2 + b2);
+}
+
+// 反射方向をサンプリングするときのpdf。guideがあればBRDFとガイディングの分布をguide->fraction()の割合で混合した分布になる。
+inline double sampling_pdf(const Material *material, const DTree *guide, const Vec &in, const Vec &normal, const Vec &out) {
+    const double brdf_pdf = material->eval_pdf(in, normal, out);
+    if (guide == NULL)
+        return brdf_pdf;
+    return guide->fraction() * guide->pdf_direction(out, normal) + (1.0 - guide->fraction()) * brdf_pdf;
+}
+
+// 光源を一つ選んでサンプリングし、hitpointにおける直接光の寄与を求める（next event estimation）。
+template <typename SceneType>
+Color sample_direct_light(const SceneType &scene, const Ray &ray, const Hitpoint &hitpoint, const Material *material, 
+                          PathGuiding *guiding, const DTree *guide, Random &random) {
+    double selection_pdf = -1;
+    const SceneSphere *light = scene.sample_light(random, hitpoint.position, hitpoint.normal, &selection_pdf);
+    if (light == NULL)
         return Color();
-    
-    // シーンと交差判定
-    Hitpoint hitpoint;
-    const SceneSphere *now_object = intersect_scene(ray, &hitpoint);
-    // 交差チェック
-    if (now_object == NULL)
-        return kBackgroundColor;
 
+    Vec dir;
+    double direction_pdf = -1;
+    if (!light->get_sphere()->sample_solid_angle(random, hitpoint.position, &dir, &direction_pdf))
+        return Color();
+
+    const double cost = dot(hitpoint.normal, dir);
+    if (cost <= 0.0)
+        return Color();
+
+    // シャドウレイ。最初に当たるのが選んだ光源でなければ遮蔽されている。
+    Hitpoint shadow_hitpoint;
+    if (scene.intersect(Ray(hitpoint.position, dir), &shadow_hitpoint) != light)
+        return Color();
+
+    const double light_pdf = selection_pdf * direction_pdf;
+    const double brdf_pdf = sampling_pdf(material, guide, ray.dir, hitpoint.normal, dir);
+    const double weight = mis_weight(light_pdf, brdf_pdf);
+    const Color emission = light->get_material()->emission();
+    if (guiding != NULL)
+        guiding->record(hitpoint.position, dir, luminance(emission) * weight / light_pdf);
+
+    const Color brdf_value = material->eval(ray.dir, hitpoint.normal, dir);
+    return multiply(brdf_value, emission) * cost * weight / light_pdf;
+}
+
+template <typename SceneType>
+Color radiance(const SceneType &scene, const Ray &ray, Random &random, const int depth, 
+               PathGuiding *guiding = NULL, const double prev_pdf = -1.0, const Vec &prev_normal = Vec());
+
+// rayが物体now_objectとhitpointで交差したときの、ray方向からの放射輝度を求める。
+// カメラからのレイの交差点が分かっているときはこれを直接呼べば交差判定を省ける。引数の意味はradiance()と同じ。
+template <typename SceneType>
+Color radiance_at_hitpoint(const SceneType &scene, const Ray &ray, const Hitpoint &hitpoint, const SceneObject *now_object, Random &random, const int depth, 
+                           PathGuiding *guiding = NULL, const double prev_pdf = -1.0, const Vec &prev_normal = Vec()) {
     // マテリアル取得
     const Material *now_material = now_object->get_material();
-    const Color emission = now_material->emission();
-    if (emission.x > 0.0 || emission.y > 0.0 || emission.z > 0.0) {
+    if (now_material->is_light()) {
+        const Color emission = now_material->emission();
         // 光源にヒットしたら放射項だけ返して終わる。
         // （今回、光源は反射率0と仮定しているため）
-        return emission;
+        if (prev_pdf < 0.0)
+            return emission;
+
+        // 光源サンプリングでも同じ経路が得られるので、MISの重みを掛ける。
+        const double light_pdf = scene.light_pdf(now_object, ray.org, prev_normal);
+        return emission * mis_weight(prev_pdf, light_pdf);
+    }
+
+    // δ関数を含むBRDFでは光源サンプリングもガイディングも使えない。
+    if (now_material->is_specular()) {
+        double pdf = -1;
+        Color brdf_value;
+        const Vec dir_out = now_material->sample(random, ray.dir, hitpoint.normal, &pdf, &brdf_value);
+        const double cost = dot(hitpoint.normal, dir_out);
+        return multiply(brdf_value, radiance(scene, Ray(hitpoint.position, dir_out), random, depth + 1, guiding)) * cost / pdf;
     }
+
+    const DTree *guide = guiding != NULL ? guiding->sampling_distribution(hitpoint.position) : NULL;
+
+    // 直接光
+    const Color direct_light = sample_direct_light(scene, ray, hitpoint, now_material, guiding, guide, random);
     
     // 次の方向をサンプリング + その方向のBRDF項の値を得る。
-    double pdf = -1;
+    double pdf = -1, guide_pdf = -1, brdf_pdf = -1;
     Color brdf_value;
-    const Vec dir_out = now_material->sample(random, ray.dir, hitpoint.normal, &pdf, &brdf_value);
+    Vec dir_out;
+    if (guide == NULL) {
+        dir_out = now_material->sample(random, ray.dir, hitpoint.normal, &pdf, &brdf_value);
+    } else {
+        // ガイディングの分布とBRDFを混合した分布からサンプリングする。
+        // 選んだ方の分布のpdfはサンプリングのときに求まるので、もう一方だけを評価する。
+        if (random.next01() < guide->fraction()) {
+            dir_out = guide->sample_direction(random, hitpoint.normal, &guide_pdf);
+            brdf_value = now_material->eval(ray.dir, hitpoint.normal, dir_out);
+            brdf_pdf = now_material->eval_pdf(ray.dir, hitpoint.normal, dir_out);
+        } else {
+            dir_out = now_material->sample(random, ray.dir, hitpoint.normal, &brdf_pdf, &brdf_value);
+            guide_pdf = guide->pdf_direction(dir_out, hitpoint.normal);
+        }
+        pdf = guide->fraction() * guide_pdf + (1.0 - guide->fraction()) * brdf_pdf;
+    }
 
     // cos項。
+    // 面の裏側に向かう方向は寄与しない（Phongの鏡面反射の方向のまわりのローブなどはサンプリングされうる）。
     const double cost = dot(hitpoint.normal, dir_out);
+    if (cost <= 0.0 || pdf <= 0.0)
+        return direct_light;
 
     // レンダリング方程式をモンテカルロ積分によって再帰的に解く。
-    const Color L = multiply(
-        brdf_value,
-        radiance(Ray(hitpoint.position, dir_out),random, depth + 1))
-        * cost / pdf;
+    const Color incoming_radiance = radiance(scene, Ray(hitpoint.position, dir_out), random, depth + 1, guiding, pdf, hitpoint.normal);
+    const Color contribution = multiply(brdf_value, incoming_radiance) * cost;
+    if (guiding != NULL) {
+        guiding->record(hitpoint.position, dir_out, luminance(incoming_radiance) / pdf);
+        if (guide != NULL)
+            guiding->record_fraction(hitpoint.position, luminance(contribution), guide_pdf, brdf_pdf, guide->fraction());
+    }
+
+    const Color L = direct_light + contribution / pdf;
     return L;
 }
 
+// ray方向からの放射輝度を求める
+// 光源を直接サンプリングし、BRDFのサンプリングとMISで組み合わせる。
+// guidingがNULLでなければ、反射方向の一部をガイディングの分布からサンプリングし、学習中なら入射放射輝度を記録する。
+// prev_pdf, prev_normalは一つ前の反射点でrayの方向をサンプリングしたときのpdfと、そこでの法線。
+// カメラから出たレイやδ関数を含むBRDFで反射したレイではprev_pdfを負にしておく。
+// sceneはSceneか、同じインターフェースを持つStaticSceneなど。
+template <typename SceneType>
+Color radiance(const SceneType &scene, const Ray &ray, Random &random, const int depth, 
+               PathGuiding *guiding, const double prev_pdf, const Vec &prev_normal) {
+    const Color kBackgroundColor = Color(0.0f, 0.0f, 0.0f);
+    const int kDepthLimit = 10;
+    // 打ち切りチェック
+    if (depth >= kDepthLimit)
+        return Color();
+    
+    // シーンと交差判定
+    Hitpoint hitpoint;
+    const SceneObject *now_object = scene.intersect(ray, &hitpoint);
+    // 交差チェック
+    if (now_object == NULL)
+        return kBackgroundColor;
+
+    return radiance_at_hitpoint(scene, ray, hitpoint, now_object, random, depth, guiding, prev_pdf, prev_normal);
+}
+
 };
 
 #endif
@@ -0,0 +1,66 @@
+﻿#ifndef	_RECT_H_
+#define	_RECT_H_
+
+#include <cmath>
+
+#include "vec.h"
+#include "ray.h"
+#include "constant.h"
+#include "hitpoint.h"
+
+namespace gemspt {
+
+// 座標軸に平行な長方形の幾何学的な情報を持つ
+// normalは±x, ±y, ±zのいずれかで、bound_min, bound_maxはその軸方向の座標が等しいこと。
+// 裏側からのレイとも交差し、法線はnormalのまま返す（裏面の扱いはSceneRectで決める）。
+class Rect {
+private:
+    int axis_;            // 法線の軸
+    double position_;     // 法線の軸方向の座標
+    double min_u_, max_u_, min_v_, max_v_; // 残りの二軸（axis_ + 1, axis_ + 2の順）の範囲
+    Vec normal_;
+public:
+    Rect(const Vec &bound_min, const Vec &bound_max, const Vec &normal) : normal_(normalize(normal)) {
+        if (fabs(normal_.x) >= fabs(normal_.y) && fabs(normal_.x) >= fabs(normal_.z))
+            axis_ = 0;
+        else if (fabs(normal_.y) >= fabs(normal_.z))
+            axis_ = 1;
+        else
+            axis_ = 2;
+        position_ = component(bound_min, axis_);
+        min_u_ = component(bound_min, (axis_ + 1) % 3);
+        max_u_ = component(bound_max, (axis_ + 1) % 3);
+        min_v_ = component(bound_min, (axis_ + 2) % 3);
+        max_v_ = component(bound_max, (axis_ + 2) % 3);
+    }
+
+    // 入力のrayに対する交差点までの距離を得る。
+    // 交差したらtrue,さもなくばfalseを返す。
+    inline bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        // 自己交差の判定用定数。
+        const double kEPS = 1e-6; 
+
+        const double dir = component(ray.dir, axis_);
+        if (dir == 0.0)
+            return false;
+
+        const double t = (position_ - component(ray.org, axis_)) / dir;
+        if (t < kEPS)
+            return false;
+
+        const Vec position = ray.org + t * ray.dir;
+        const double u = component(position, (axis_ + 1) % 3);
+        const double v = component(position, (axis_ + 2) % 3);
+        if (u < min_u_ || u > max_u_ || v < min_v_ || v > max_v_)
+            return false;
+
+        hitpoint->distance = t;
+        hitpoint->position = position;
+        hitpoint->normal   = normal_;
+        return true;
+    }
+};
+
+};
+
+#endif
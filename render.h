@@ -2,48 +2,40 @@
 #define _RENDER_H_
 
 #include <iostream>
+#include <vector>
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif // _OPENMP
 
+#include "camera.h"
 #include "radiance.h"
 #include "ppm.h"
 #include "random.h"
 
 namespace gemspt {
 
-int render(const char *filename, const int width, const int height, const int num_sample_per_subpixel, const int num_subpixel, const int num_thread) {
-#ifdef _OPENMP
-    omp_set_num_threads(num_thread);
-#endif // _OPENMP
-    
-    // カメラ位置。
-    const Vec camera_position = Vec(7.0, 3.0, 7.0);
-    const Vec camera_lookat   = Vec(0.0, 1.0, 0.0);
-    const Vec camera_dir      = normalize(camera_lookat - camera_position);
-    const Vec camera_up       = Vec(0.0, 1.0, 0.0);
-
-    // ワールド座標系でのイメージセンサーの大きさ。
-    const double sensor_width = 30.0 * width / height; // アスペクト比調整。
-    const double sensor_height= 30.0;
-    // イメージセンサーまでの距離。
-    const double sensor_dist  = 45.0;
-    // イメージセンサーを張るベクトル。
-    const Vec sensor_x_vec = normalize(cross(camera_dir, camera_up)) * sensor_width;
-    const Vec sensor_y_vec = normalize(cross(sensor_x_vec, camera_dir)) * sensor_height;
-    const Vec sensor_center = camera_position + camera_dir * sensor_dist;
+// シーンをレンダリングしてimageに書き込む。imageはwidth * height要素。
+// seedを変えると独立な乱数列でレンダリングする。guidingを渡すとパスガイディングを使う。
+// varianceを渡すと、画素ごとの推定値（image）の分散の見積もりを書き込む。画素内の全サンプルの標本分散をサンプル数で割ったもので、
+// サブピクセルの位置の違いによる分散も含むので、エッジでは大きめになる。
+template <typename SceneType>
+void render_image(const SceneType &scene, const int width, const int height, const int num_sample_per_subpixel, const int num_subpixel, 
+                  const unsigned long long seed, const bool show_progress, Color *image, PathGuiding *guiding = NULL, Color *variance = NULL) {
+    const Camera camera = default_camera(width, height);
+
+    for (int i = 0; i < width * height; ++i)
+        image[i] = Color();
 
-    Color *image = new Color[width * height];
-    std::cout << width << "x" << height << " " << num_sample_per_subpixel * (num_subpixel * num_subpixel) << " spp" << std::endl;
-    
     for (int y = 0; y < height; ++y) {
-        std::cerr << "Rendering (y = " << y << ", " << (100.0 * y / (height - 1)) << " %)          \r";
+        if (show_progress)
+            std::cerr << "Rendering (y = " << y << ", " << (100.0 * y / (height - 1)) << " %)          \r";
 #pragma omp parallel for schedule(static) // OpenMP
         for (int x = 0; x < width; ++x) {
-            Random random(y * width + x + 1);
+            Random random(seed * width * height + y * width + x + 1);
 
             const int image_index = (height - y - 1) * width + x;
+            Color sum, sum_squared;
             // num_subpixel x num_subpixel のスーパーサンプリング。
             for (int sy = 0; sy < num_subpixel; ++sy) {
                 for (int sx = 0; sx < num_subpixel; ++sx) {
@@ -53,24 +45,37 @@ int render(const char *filename, const int width, const int height, const int nu
                         const double rate = (1.0 / num_subpixel);
                         const double r1 = sx * rate + rate / 2.0;
                         const double r2 = sy * rate + rate / 2.0;
-                        // イメージセンサー上の位置。
-                        const Vec position_on_sensor = 
-                            sensor_center + 
-                            sensor_x_vec * ((r1 + x) / width - 0.5) +
-                            sensor_y_vec * ((r2 + y) / height- 0.5);
-                        // レイを飛ばす方向。
-                        const Vec dir = normalize(position_on_sensor - camera_position);
 
+                        const Color sample = radiance(scene, camera.generate_ray(r1 + x, r2 + y), random, 0, guiding);
                         accumulated_radiance = accumulated_radiance + 
-                            radiance(Ray(camera_position, dir), random, 0) 
-                            / (double)num_sample_per_subpixel / (double)(num_subpixel * num_subpixel);
+                            sample / (double)num_sample_per_subpixel / (double)(num_subpixel * num_subpixel);
+                        sum = sum + sample;
+                        sum_squared = sum_squared + multiply(sample, sample);
                     }
                     image[image_index] = image[image_index] + accumulated_radiance;
                 }
             }
+            if (variance != NULL) {
+                const double n = num_sample_per_subpixel * num_subpixel * num_subpixel;
+                const Color mean = sum / n;
+                variance[image_index] = n > 1.0 ? (sum_squared / n - multiply(mean, mean)) / (n - 1.0) : Color();
+            }
         }
     }
-    std::cout << std::endl;
+    if (show_progress)
+        std::cout << std::endl;
+}
+
+template <typename SceneType>
+int render(const char *filename, const SceneType &scene, const int width, const int height, const int num_sample_per_subpixel, const int num_subpixel, const int num_thread) {
+#ifdef _OPENMP
+    omp_set_num_threads(num_thread);
+#endif // _OPENMP
+
+    Color *image = new Color[width * height];
+    std::cout << width << "x" << height << " " << num_sample_per_subpixel * (num_subpixel * num_subpixel) << " spp" << std::endl;
+    
+    render_image(scene, width, height, num_sample_per_subpixel, num_subpixel, 0, true, image);
     
     // 出力
     save_ppm_file(filename, image, width, height);
@@ -79,6 +84,116 @@ int render(const char *filename, const int width, const int height, const int nu
     return 0;
 }
 
+// カメラから見える範囲のバウンディングボックスを、格子状に飛ばしたレイの交差点から見積もる。
+void estimate_visible_bounds(const Scene &scene, const Camera &camera, const int width, const int height, Vec *bound_min, Vec *bound_max) {
+    const int kGrid = 64;
+    *bound_min = Vec(kINF, kINF, kINF);
+    *bound_max = Vec(-kINF, -kINF, -kINF);
+    for (int y = 0; y <= kGrid; ++y) {
+        for (int x = 0; x <= kGrid; ++x) {
+            Hitpoint hitpoint;
+            if (scene.intersect(camera.generate_ray(x * width / (double)kGrid, y * height / (double)kGrid), &hitpoint) == NULL)
+                continue;
+            const Vec &p = hitpoint.position;
+            *bound_min = component_min(*bound_min, p);
+            *bound_max = component_max(*bound_max, p);
+        }
+    }
+    if (bound_min->x > bound_max->x) {
+        *bound_min = *bound_max = camera.position();
+    }
+
+    // 少し広げておく。
+    const Vec margin = (*bound_max - *bound_min) * 0.05 + Vec(1e-3, 1e-3, 1e-3);
+    *bound_min = *bound_min - margin;
+    *bound_max = *bound_max + margin;
+}
+
+// パスガイディングを使ってレンダリングし、imageに書き込む。imageはwidth * height要素。
+// まずサブピクセルごとに1, 2, 4, ...サンプル（num_training_pass回）のパスでガイディングの分布を学習しながらレンダリングし、
+// 最後に学習した分布を使ってサブピクセルごとにnum_sample_per_subpixelサンプルでレンダリングする。
+// 学習中のパスの画像も捨てず、分散の見積もりに反比例する重みで最後のパスの画像と平均する（inverse-variance weighting）。
+// Müller. "Practical Path Guiding" in Production. SIGGRAPH 2019 Course Notes.
+// 分散は画素ごとの分散を、全パスをサンプル数で重み付けした平均の画像で割った相対分散（bench_util.hの相対MSEと同じ形）の平均で見積もる。
+//
+// 組み込みシーン（bench_guiding 40 30 512 7）では、パスごとのサンプルあたりの分散が大きく変わらないため、
+// この重みはサンプル数に比例した重みとほぼ同じになり、結果もほとんど変わらない。
+// 同じサンプル数での相対MSEは拡散面のシーンで8-128 sppではBRDFだけのサンプリングより最大16%大きく、256 sppで4%小さい程度。
+// 1サンプルあたりの時間も1.3-1.8倍かかるので、効率は8 spp以上ではどのシーンでもBRDFだけのサンプリングの0.6-0.9倍にとどまる。
+void render_guided_image(const Scene &scene, const int width, const int height, const int num_sample_per_subpixel, const int num_subpixel,
+                         const int num_training_pass, const unsigned long long seed, const bool show_progress, Color *image) {
+    Vec bound_min, bound_max;
+    estimate_visible_bounds(scene, default_camera(width, height), width, height, &bound_min, &bound_max);
+    PathGuiding guiding(bound_min, bound_max);
+
+    for (int i = 0; i < width * height; ++i)
+        image[i] = Color();
+
+    std::vector<std::vector<Color> > pass_images(num_training_pass + 1, std::vector<Color>(width * height));
+    std::vector<std::vector<Color> > pass_variances(num_training_pass + 1, std::vector<Color>(width * height));
+    int total_sample = 0;
+    for (int pass = 0; pass <= num_training_pass; ++pass) {
+        const bool training = pass < num_training_pass;
+        const int num_sample = training ? 1 << pass : num_sample_per_subpixel;
+        guiding.set_training(training);
+        if (show_progress) {
+            std::cout << (training ? "Training pass " : "Final pass ") << pass << " ("
+                      << num_sample * (num_subpixel * num_subpixel) << " spp)" << std::endl;
+        }
+        render_image(scene, width, height, num_sample, num_subpixel, seed * (num_training_pass + 1) + pass, show_progress && !training,
+                     &pass_images[pass][0], &guiding, &pass_variances[pass][0]);
+        if (training)
+            guiding.next_iteration();
+
+        // 相対分散の分母にする、サンプル数で重み付けした平均。
+        total_sample += num_sample;
+        const double weight = num_sample / (double)total_sample;
+        for (int i = 0; i < width * height; ++i)
+            image[i] = image[i] * (1.0 - weight) + pass_images[pass][i] * weight;
+    }
+
+    // パスごとの相対分散の逆数を重みにする。
+    const double kEPS = 1e-2;
+    std::vector<double> weights(num_training_pass + 1);
+    double total_weight = 0.0;
+    for (int pass = 0; pass <= num_training_pass; ++pass) {
+        double relative_variance = 0.0;
+        for (int i = 0; i < width * height; ++i) {
+            const Color &v = pass_variances[pass][i];
+            relative_variance += v.x / (image[i].x * image[i].x + kEPS) + v.y / (image[i].y * image[i].y + kEPS) + v.z / (image[i].z * image[i].z + kEPS);
+        }
+        // 分散が見積もれない（真っ黒な）画像ならサンプル数で重み付けした平均のままにする。
+        if (!(relative_variance > 0.0))
+            return;
+        weights[pass] = 1.0 / relative_variance;
+        total_weight += weights[pass];
+    }
+    for (int i = 0; i < width * height; ++i) {
+        image[i] = Color();
+        for (int pass = 0; pass <= num_training_pass; ++pass)
+            image[i] = image[i] + pass_images[pass][i] * (weights[pass] / total_weight);
+    }
+}
+
+// パスガイディングを使ってレンダリングする。サンプル数の数え方はrender_guided_image()と同じ。
+int render_guided(const char *filename, const Scene &scene, const int width, const int height, const int num_sample_per_subpixel, const int num_subpixel, 
+                  const int num_training_pass, const int num_thread) {
+#ifdef _OPENMP
+    omp_set_num_threads(num_thread);
+#endif // _OPENMP
+
+    Color *image = new Color[width * height];
+    std::cout << width << "x" << height << " " << ((1 << num_training_pass) - 1 + num_sample_per_subpixel) * (num_subpixel * num_subpixel)
+              << " spp in total" << std::endl;
+    render_guided_image(scene, width, height, num_sample_per_subpixel, num_subpixel, num_training_pass, 0, true, image);
+
+    // 出力
+    save_ppm_file(filename, image, width, height);
+    delete[] image;
+
+    return 0;
+}
+
 
 };
 
@@ -1,6 +1,8 @@
 ﻿#ifndef _SAMPLING_H_
 #define _SAMPLING_H_
 
+#include <algorithm>
+
 #include "vec.h"
 #include "random.h"
 #include "constant.h"
@@ -30,6 +32,17 @@ public:
 
         return tz * normal + tx * tangent + ty * binormal;
     }
+
+    // axisを中心とする、1-cosθmaxで指定される円錐内の方向を一様サンプリングする。
+    static Vec uniformCone(Random &random, const double one_minus_cos_max, const Vec &axis, const Vec &tangent, const Vec &binormal) {
+        const double tz = 1.0 - random.next01() * one_minus_cos_max;
+        const double phi = random.next(0.0, 2.0 * kPI);
+        const double k = sqrt(std::max(0.0, 1.0 - tz * tz));
+        const double tx = k * cos(phi);
+        const double ty = k * sin(phi);
+
+        return tz * axis + tx * tangent + ty * binormal;
+    }
 };
 
 }
@@ -1,8 +1,15 @@
 ﻿#ifndef	_SCENE_H_
 #define	_SCENE_H_
 
+#include <vector>
+
 #include "constant.h"
+#include "random.h"
 #include "sphere.h"
+#include "plane.h"
+#include "rect.h"
+#include "mesh.h"
+#include "light_tree.h"
 #include "material.h"
 #include "hitpoint.h"
 
@@ -12,80 +19,447 @@ namespace gemspt {
 // #define SCENE_SPECULAR
 // #define SCENE_GLASS
 
-class SceneSphere {
+// シーン中の物体が共通して持つ情報。
+class SceneObject {
 private:
-    Sphere sphere_;
     const Material *material_;
+    int material_id_; // Scene中のマテリアルの番号
+    int light_index_; // 光源として直接サンプリングできる物体なら光源番号、そうでなければ-1
+public:
+    SceneObject(const Material *material) : material_(material), material_id_(-1), light_index_(-1) {}
+
+    const Material* get_material() const {
+        return material_;
+    }
+
+    int material_id() const {
+        return material_id_;
+    }
+
+    void set_material(const int material_id, const Material *material) {
+        material_id_ = material_id;
+        material_ = material;
+    }
+
+    // 長方形や開いたメッシュは裏側からも見えるので、光を通さないマテリアルでは法線をレイの来た側に向ける。
+    // 光を通すマテリアル（GlassMaterial）は法線の向きで内外を判定するので、幾何学的な法線のままにする。
+    // つまりそのような長方形やメッシュは片面で、法線の側が外側になる。
+    void orient_normal(const Ray &ray, Hitpoint *hitpoint) const {
+        if (!material_->is_transmissive() && dot(hitpoint->normal, ray.dir) > 0.0)
+            hitpoint->normal = -hitpoint->normal;
+    }
+
+    int light_index() const {
+        return light_index_;
+    }
+
+    void set_light_index(const int light_index) {
+        light_index_ = light_index;
+    }
+};
+
+class SceneSphere : public SceneObject {
+private:
+    Sphere sphere_;
 public:
     SceneSphere(const Sphere &sphere, const Material *material) :
-      sphere_(sphere), material_(material) {}
+      SceneObject(material), sphere_(sphere) {}
 
     const Sphere* get_sphere() const {
         return &sphere_;
     }
 
-    const Material* get_material() const {
-        return material_;
+    bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        return sphere_.intersect(ray, hitpoint);
+    }
+};
+
+class ScenePlane : public SceneObject {
+private:
+    Plane plane_;
+public:
+    ScenePlane(const Plane &plane, const Material *material) :
+      SceneObject(material), plane_(plane) {}
+
+    const Plane* get_plane() const {
+        return &plane_;
+    }
+
+    bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        return plane_.intersect(ray, hitpoint);
     }
 };
 
-// シーンとの交差判定関数。
-inline const SceneSphere* intersect_scene(const Ray &ray, Hitpoint *hitpoint) {
-    // レンダリングするシーンデータ。
-    // 簡単のため、球のみで構成することにする。
+class SceneRect : public SceneObject {
+private:
+    Rect rect_;
+public:
+    SceneRect(const Rect &rect, const Material *material) :
+      SceneObject(material), rect_(rect) {}
+
+    const Rect* get_rect() const {
+        return &rect_;
+    }
+
+    bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        if (!rect_.intersect(ray, hitpoint))
+            return false;
+        orient_normal(ray, hitpoint);
+        return true;
+    }
+};
+
+class SceneMesh : public SceneObject {
+private:
+    TriangleMesh mesh_;
+public:
+    SceneMesh(const TriangleMesh &mesh, const Material *material) :
+      SceneObject(material), mesh_(mesh) {}
+
+    const TriangleMesh* get_mesh() const {
+        return &mesh_;
+    }
+
+    bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        if (!mesh_.intersect(ray, hitpoint))
+            return false;
+        orient_normal(ray, hitpoint);
+        return true;
+    }
+};
+
+// 光源の選択方法。
+enum LightSelection {
+    kLightSelectionUniform, // 全光源から一様に選ぶ
+    kLightSelectionTree,    // LightTreeを使い寄与の見積もりに比例して選ぶ
+};
+
+// レンダリングするシーン。
+// 球、無限平面、座標軸に平行な長方形、三角形メッシュで構成する。
+// 光源として直接サンプリングするのは放射のある球だけで、それ以外の放射のある物体にはBRDFのサンプリングで当たったときだけ寄与する。
+// マテリアルはSceneが所有し、デストラクタで解放する。
+class Scene {
+private:
+    std::vector<SceneSphere> spheres_;
+    std::vector<ScenePlane> planes_;
+    std::vector<SceneRect> rects_;
+    std::vector<SceneMesh> meshes_;
+    std::vector<const Material*> materials_;
+    std::vector<int> lights_;             // 光源の球の番号
+    LightTree light_tree_;
+    LightSelection light_selection_;
+
+    Scene(const Scene&);
+    Scene& operator=(const Scene&);
+
+    // objectsの中でrayと最も近くで交差するものを探し、hitpointより近ければ更新する。
+    template <typename T>
+    static void intersect_objects(const std::vector<T> &objects, const Ray &ray, Hitpoint *hitpoint, const SceneObject **now_object) {
+        const int n = (int)objects.size();
+
+        // 線形探索
+        for (int i = 0; i < n; i ++) {
+            Hitpoint tmp_hitpoint;
+            if (objects[i].intersect(ray, &tmp_hitpoint)) {
+                if (tmp_hitpoint.distance < hitpoint->distance) {
+                    *hitpoint = tmp_hitpoint;
+                    *now_object = &objects[i];
+                }
+            }
+        }
+    }
+
+    // objectsのうちマテリアルmaterial_idを使う物体のマテリアルをmaterialにする。
+    template <typename T>
+    static void replace_material(std::vector<T> *objects, const int material_id, const Material *material) {
+        for (size_t i = 0; i < objects->size(); ++i) {
+            if ((*objects)[i].material_id() == material_id)
+                (*objects)[i].set_material(material_id, material);
+        }
+    }
+public:
+    Scene() : light_selection_(kLightSelectionTree) {}
+    ~Scene() {
+        for (size_t i = 0; i < materials_.size(); ++i)
+            delete materials_[i];
+    }
+
+    void add(const Sphere &sphere, const Material *material) {
+        spheres_.push_back(SceneSphere(sphere, material));
+        spheres_.back().set_material((int)materials_.size(), material);
+        materials_.push_back(material);
+    }
+
+    void add(const Plane &plane, const Material *material) {
+        planes_.push_back(ScenePlane(plane, material));
+        planes_.back().set_material((int)materials_.size(), material);
+        materials_.push_back(material);
+    }
+
+    void add(const Rect &rect, const Material *material) {
+        rects_.push_back(SceneRect(rect, material));
+        rects_.back().set_material((int)materials_.size(), material);
+        materials_.push_back(material);
+    }
+
+    // meshはbuild()済みであること。
+    void add(const TriangleMesh &mesh, const Material *material) {
+        meshes_.push_back(SceneMesh(mesh, material));
+        meshes_.back().set_material((int)materials_.size(), material);
+        materials_.push_back(material);
+    }
+
+    // 光源を集めて光源の階層構造を構築する。オブジェクトを追加し終えたら呼ぶ。
+    void build() {
+        std::vector<LightTree::Light> lights;
+        lights_.clear();
+        for (int i = 0; i < (int)spheres_.size(); ++i) {
+            if (spheres_[i].get_material()->is_light()) {
+                const Color emission = spheres_[i].get_material()->emission();
+                const Sphere *sphere = spheres_[i].get_sphere();
+                // 球光源の放射束: π * 放射輝度 * 表面積
+                const double power = kPI * luminance(emission) * 4.0 * kPI * sphere->radius() * sphere->radius();
+                spheres_[i].set_light_index((int)lights_.size());
+                lights_.push_back(i);
+                lights.push_back(LightTree::Light(sphere->position(), sphere->radius(), power));
+            } else {
+                spheres_[i].set_light_index(-1);
+            }
+        }
+        light_tree_.build(lights);
+    }
+
+    void set_light_selection(const LightSelection light_selection) {
+        light_selection_ = light_selection;
+    }
+
+    int num_objects() const {
+        return (int)(spheres_.size() + planes_.size() + rects_.size() + meshes_.size());
+    }
+
+    int num_spheres() const {
+        return (int)spheres_.size();
+    }
+
+    int num_planes() const {
+        return (int)planes_.size();
+    }
+
+    int num_lights() const {
+        return (int)lights_.size();
+    }
+
+    const SceneSphere& sphere(const int index) const {
+        return spheres_[index];
+    }
+
+    const ScenePlane& plane(const int index) const {
+        return planes_[index];
+    }
+
+    const SceneSphere& light(const int index) const {
+        return spheres_[lights_[index]];
+    }
+
+    int num_materials() const {
+        return (int)materials_.size();
+    }
+
+    // マテリアルの番号はadd()した順。
+    const Material* material(const int material_id) const {
+        return materials_[material_id];
+    }
+
+    // マテリアルmaterial_idをmaterialに置き換え、古いマテリアルを解放する。
+    // そのマテリアルを使う物体はmaterialを使うようになる。放射の有無が変わることがあるので光源も作り直す。
+    void replace_material(const int material_id, const Material *material) {
+        delete materials_[material_id];
+        materials_[material_id] = material;
+        replace_material(&spheres_, material_id, material);
+        replace_material(&planes_, material_id, material);
+        replace_material(&rects_, material_id, material);
+        replace_material(&meshes_, material_id, material);
+        build();
+    }
+
+    // シーンとの交差判定関数。
+    inline const SceneObject* intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        // 初期化
+        *hitpoint = Hitpoint();
+        const SceneObject *now_object = NULL;
+
+        intersect_objects(spheres_, ray, hitpoint, &now_object);
+        intersect_objects(planes_, ray, hitpoint, &now_object);
+        intersect_objects(rects_, ray, hitpoint, &now_object);
+        intersect_objects(meshes_, ray, hitpoint, &now_object);
+
+        return now_object;
+    }
+
+    // 点position（法線normal）から見て光源を一つ選ぶ。選べなければNULL。
+    // pdfには選択確率が入る。
+    const SceneSphere* sample_light(Random &random, const Vec &position, const Vec &normal, double *pdf) const {
+        if (lights_.empty())
+            return NULL;
+
+        if (light_selection_ == kLightSelectionUniform) {
+            int index = (int)(random.next01() * lights_.size());
+            if (index >= (int)lights_.size())
+                index = (int)lights_.size() - 1;
+            *pdf = 1.0 / lights_.size();
+            return &spheres_[lights_[index]];
+        }
+
+        const int index = light_tree_.sample(random, position, normal, pdf);
+        if (index < 0)
+            return NULL;
+        return &spheres_[lights_[index]];
+    }
+
+    // sample_light()でobjectを選び、Sphere::sample_solid_angle()で点positionからobjectへの方向を得るときのpdf（立体角測度）。
+    // 直接サンプリングできない物体なら0。
+    double light_pdf(const SceneObject *object, const Vec &position, const Vec &normal) const {
+        const int index = object->light_index();
+        if (index < 0)
+            return 0.0;
+
+        const double direction_pdf = spheres_[lights_[index]].get_sphere()->pdf_solid_angle(position);
+        if (light_selection_ == kLightSelectionUniform)
+            return direction_pdf / lights_.size();
+        return light_tree_.pdf(index, position, normal) * direction_pdf;
+    }
+};
+
+// 組み込みシーンの種類。
+enum BuiltinScene {
+    kSceneDiffuseOnly,
+    kSceneSpecular,
+    kSceneGlass,
+};
+
 #if defined(SCENE_DIFFUSE_ONLY)
-    static const SceneSphere scene[] = {
-        SceneSphere(Sphere(100000.0, Vec( 0.0, -100000.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec( 0.0,  100004.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec(-100003.0,  0.0,       0.0)), new LambertianMaterial(Color(0.7, 0.1, 0.1))),
-        SceneSphere(Sphere(100000.0, Vec( 100009.0,  0.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec(0.0,        0.0, -100003.0)), new LambertianMaterial(Color(0.1, 0.7, 0.1))),
-        SceneSphere(Sphere(100.0,    Vec( 0.0,    103.99,       0.0)), new Lightsource       (Color(8.0, 8.0, 8.0))),
-        SceneSphere(Sphere(1.0,      Vec(-2.0,       1.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(1.0,      Vec( 2.0,       1.0,       0.0)), new LambertianMaterial(Color(0.1, 0.1, 0.7))),
-    };
+const BuiltinScene kDefaultScene = kSceneDiffuseOnly;
 #elif defined(SCENE_SPECULAR)
-    static const SceneSphere scene[] = {
-        SceneSphere(Sphere(100000.0, Vec( 0.0, -100000.0,       0.0)), new PhongMaterial     (Color(0.999, 0.999, 0.999), 100.0)),
-        SceneSphere(Sphere(100000.0, Vec( 0.0,  100004.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec(-100003.0,  0.0,       0.0)), new LambertianMaterial(Color(0.7, 0.1, 0.1))),
-        SceneSphere(Sphere(100000.0, Vec( 100009.0,  0.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec(0.0,        0.0, -100003.0)), new LambertianMaterial(Color(0.1, 0.7, 0.1))),
-        SceneSphere(Sphere(100.0,    Vec( 0.0,    103.99,       0.0)), new Lightsource       (Color(8.0, 8.0, 8.0))),
-        SceneSphere(Sphere(1.0,      Vec(-2.0,       1.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(1.0,      Vec( 2.0,       1.0,       0.0)), new LambertianMaterial(Color(0.1, 0.1, 0.7))),
-    };
+const BuiltinScene kDefaultScene = kSceneSpecular;
 #elif defined(SCENE_GLASS)
-    static const SceneSphere scene[] = {
-        SceneSphere(Sphere(100000.0, Vec( 0.0, -100000.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec( 0.0,  100004.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec(-100003.0,  0.0,       0.0)), new LambertianMaterial(Color(0.7, 0.1, 0.1))),
-        SceneSphere(Sphere(100000.0, Vec( 100009.0,  0.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(100000.0, Vec(0.0,        0.0, -100003.0)), new LambertianMaterial(Color(0.1, 0.7, 0.1))),
-        SceneSphere(Sphere(100.0,    Vec( 0.0,    103.99,       0.0)), new Lightsource       (Color(8.0, 8.0, 8.0))),
-        SceneSphere(Sphere(1.0,      Vec(-2.0,       1.0,       0.0)), new LambertianMaterial(Color(0.7, 0.7, 0.7))),
-        SceneSphere(Sphere(1.0,      Vec( 2.0,       1.0,       0.0)), new GlassMaterial     (Color(0.999999, 0.999999, 0.999999), 1.5)),
-    };
+const BuiltinScene kDefaultScene = kSceneGlass;
 #endif
 
-    const int n = sizeof(scene) / sizeof(SceneSphere);
-
-    // 初期化
-    *hitpoint = Hitpoint();
-    const SceneSphere *now_object = NULL;
-    
-    // 線形探索
-    for (int i = 0; i < n; i ++) { 
-        Hitpoint tmp_hitpoint;
-        if (scene[i].get_sphere()->intersect(ray, &tmp_hitpoint)) {
-            if (tmp_hitpoint.distance < hitpoint->distance) {
-                *hitpoint = tmp_hitpoint;
-                now_object = &scene[i];
-            }
-        }
+// 組み込みシーンの球。半径の二乗を前計算しておく。
+struct StaticSphere {
+    double radius, radius_squared;
+    double x, y, z;
+
+    constexpr StaticSphere(const double radius, const double x, const double y, const double z) :
+      radius(radius), radius_squared(radius * radius), x(x), y(y), z(z) {}
+
+    Sphere sphere() const {
+        return Sphere(radius, Vec(x, y, z));
     }
+};
+
+// 組み込みシーンの無限平面。法線は正規化済みであること。
+struct StaticPlane {
+    double nx, ny, nz;
+    double px, py, pz; // 平面上の点
+    double offset;     // 平面上の点pについて dot(n, p) = offset
+
+    constexpr StaticPlane(const double nx, const double ny, const double nz, const double px, const double py, const double pz) :
+      nx(nx), ny(ny), nz(nz), px(px), py(py), pz(pz), offset(nx * px + ny * py + nz * pz) {}
+
+    Plane plane() const {
+        return Plane(Vec(nx, ny, nz), Vec(px, py, pz));
+    }
+};
 
-    return now_object;
+// 組み込みシーンの物体の配置。三つの組み込みシーンはマテリアル以外同じ。
+// setup_builtin_scene()はこの配置からシーンを作り、StaticScene（static_scene.h）はこの配置で交差判定を展開する。
+struct StaticBuiltinScene {
+    static const int kNumSpheres = 3;
+    static const int kNumPlanes = 5;
+
+    static constexpr StaticSphere kSpheres[kNumSpheres] = {
+        StaticSphere(100.0,  0.0, 103.99, 0.0), // 光源
+        StaticSphere(1.0,   -2.0,   1.0,  0.0),
+        StaticSphere(1.0,    2.0,   1.0,  0.0),
+    };
+
+    static constexpr StaticPlane kPlanes[kNumPlanes] = {
+        StaticPlane( 0.0,  1.0,  0.0,   0.0, 0.0,  0.0), // 床
+        StaticPlane( 0.0, -1.0,  0.0,   0.0, 4.0,  0.0), // 天井
+        StaticPlane( 1.0,  0.0,  0.0,  -3.0, 0.0,  0.0), // 左の壁
+        StaticPlane(-1.0,  0.0,  0.0,   9.0, 0.0,  0.0), // 右の壁
+        StaticPlane( 0.0,  0.0,  1.0,   0.0, 0.0, -3.0), // 奥の壁
+    };
+};
+
+constexpr StaticSphere StaticBuiltinScene::kSpheres[StaticBuiltinScene::kNumSpheres];
+constexpr StaticPlane StaticBuiltinScene::kPlanes[StaticBuiltinScene::kNumPlanes];
+
+// 組み込みシーンtypeのマテリアルを作り、StaticBuiltinSceneの平面と球の順にplane_materials, sphere_materialsへ入れる。
+// シーンによって床と右の球のマテリアルだけが異なる。
+inline void create_builtin_materials(const BuiltinScene type,
+    const Material *plane_materials[StaticBuiltinScene::kNumPlanes], const Material *sphere_materials[StaticBuiltinScene::kNumSpheres]) {
+    plane_materials[0] = type == kSceneSpecular ?
+        (const Material*)new PhongMaterial(Color(0.999, 0.999, 0.999), 100.0) : new LambertianMaterial(Color(0.7, 0.7, 0.7));
+    plane_materials[1] = new LambertianMaterial(Color(0.7, 0.7, 0.7));
+    plane_materials[2] = new LambertianMaterial(Color(0.7, 0.1, 0.1));
+    plane_materials[3] = new LambertianMaterial(Color(0.7, 0.7, 0.7));
+    plane_materials[4] = new LambertianMaterial(Color(0.1, 0.7, 0.1));
+
+    sphere_materials[0] = new Lightsource(Color(8.0, 8.0, 8.0));
+    sphere_materials[1] = new LambertianMaterial(Color(0.7, 0.7, 0.7));
+    sphere_materials[2] = type == kSceneGlass ?
+        (const Material*)new GlassMaterial(Color(0.999999, 0.999999, 0.999999), 1.5) : new LambertianMaterial(Color(0.1, 0.1, 0.7));
+}
+
+// 組み込みシーンをセットアップする。
+// 箱の壁は無限平面で表す。配置はStaticBuiltinSceneのもので、マテリアルはcreate_builtin_materials()で作る。
+// 平面、球の順に追加するので、マテリアルの番号は0-4が壁、5が光源、6-7が球になる。
+// 省略時はSCENE_DIFFUSE_ONLY, SCENE_SPECULAR, SCENE_GLASSのいずれかで選んだシーンになる。
+inline void setup_builtin_scene(Scene *scene, const BuiltinScene type = kDefaultScene) {
+    typedef StaticBuiltinScene Layout;
+    const Material *plane_materials[Layout::kNumPlanes];
+    const Material *sphere_materials[Layout::kNumSpheres];
+    create_builtin_materials(type, plane_materials, sphere_materials);
+
+    for (int i = 0; i < Layout::kNumPlanes; ++i)
+        scene->add(Layout::kPlanes[i].plane(), plane_materials[i]);
+    for (int i = 0; i < Layout::kNumSpheres; ++i)
+        scene->add(Layout::kSpheres[i].sphere(), sphere_materials[i]);
+    scene->build();
+}
+
+// 多数光源のベンチマーク用シーンをセットアップする。
+// 組み込みシーンと同じ箱の奥の壁と天井に、num_lights個の小さな球光源をランダムに配置する（LEDウォールや街の灯りを想定）。
+// 光源の強さは対数的にばらつかせ、少数の明るい光源と多数の暗い光源が混在するようにする。
+inline void setup_many_lights_scene(Scene *scene, const int num_lights, const unsigned long long seed) {
+    typedef StaticBuiltinScene Layout;
+    const Color wall_colors[Layout::kNumPlanes] = {
+        Color(0.7, 0.7, 0.7), Color(0.7, 0.7, 0.7), Color(0.7, 0.1, 0.1), Color(0.7, 0.7, 0.7), Color(0.1, 0.7, 0.1),
+    };
+    for (int i = 0; i < Layout::kNumPlanes; ++i)
+        scene->add(Layout::kPlanes[i].plane(), new LambertianMaterial(wall_colors[i]));
+    // 組み込みシーンの光源（kSpheres[0]）は置かない。
+    scene->add(Layout::kSpheres[1].sphere(), new LambertianMaterial(Color(0.7, 0.7, 0.7)));
+    scene->add(Layout::kSpheres[2].sphere(), new LambertianMaterial(Color(0.1, 0.1, 0.7)));
+
+    const double kLightRadius = 0.02;
+    Random random(seed);
+    for (int i = 0; i < num_lights; ++i) {
+        Vec position;
+        if (random.next01() < 0.5) {
+            // 奥の壁 (z = -3)
+            position = Vec(random.next(-2.9, 8.9), random.next(0.1, 3.9), -3.0 + kLightRadius * 2.0);
+        } else {
+            // 天井 (y = 4)
+            position = Vec(random.next(-2.9, 8.9), 4.0 - kLightRadius * 2.0, random.next(-2.9, 6.0));
+        }
+        const double intensity = 2.5 * pow(10.0, random.next(-2.0, 1.0));
+        const Color color(random.next(0.5, 1.0), random.next(0.5, 1.0), random.next(0.5, 1.0));
+        scene->add(Sphere(kLightRadius, position), new Lightsource(color * intensity));
+    }
+    scene->build();
 }
 
 };
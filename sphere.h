@@ -5,6 +5,8 @@
 
 #include "vec.h"
 #include "ray.h"
+#include "random.h"
+#include "sampling.h"
 #include "constant.h"
 #include "hitpoint.h"
 
@@ -19,6 +21,14 @@ public:
     Sphere(const double radius, const Vec &position) :
       radius_(radius), position_(position) {}
 
+    double radius() const {
+        return radius_;
+    }
+
+    const Vec& position() const {
+        return position_;
+    }
+
     // 入力のrayに対する交差点までの距離を得る。
     // 交差したらtrue,さもなくばfalseを返す。
     inline bool intersect(const Ray &ray, Hitpoint *hitpoint) const {
@@ -51,6 +61,39 @@ public:
         hitpoint->normal   = normalize(hitpoint->position - position_);
         return true;
     }
+
+    // 点fromから球を見込む立体角の1-cosθmaxを得る。fromが球の内部にある場合は0を返す。
+    inline double one_minus_cos_theta_max(const Vec &from) const {
+        const double distance_squared = (position_ - from).length_squared();
+        const double sin2 = radius_ * radius_ / distance_squared;
+        if (sin2 >= 1.0)
+            return 0.0;
+        // 1 - sqrt(1 - sin2)をそのまま計算すると小さな光源で桁落ちするため変形しておく。
+        return sin2 / (1.0 + sqrt(1.0 - sin2));
+    }
+
+    // 点fromから球を見込む立体角内で方向を一様サンプリングする。
+    // pdfは立体角測度。fromが球の内部にあるときはfalseを返す。
+    inline bool sample_solid_angle(Random &random, const Vec &from, Vec *dir, double *pdf) const {
+        const double one_minus_cos_max = one_minus_cos_theta_max(from);
+        if (one_minus_cos_max <= 0.0)
+            return false;
+
+        const Vec axis = normalize(position_ - from);
+        Vec tangent, binormal;
+        createOrthoNormalBasis(axis, &tangent, &binormal);
+        *dir = Sampling::uniformCone(random, one_minus_cos_max, axis, tangent, binormal);
+        *pdf = 1.0 / (2.0 * kPI * one_minus_cos_max);
+        return true;
+    }
+
+    // sample_solid_angle()で方向をサンプリングしたときのpdf。
+    inline double pdf_solid_angle(const Vec &from) const {
+        const double one_minus_cos_max = one_minus_cos_theta_max(from);
+        if (one_minus_cos_max <= 0.0)
+            return 0.0;
+        return 1.0 / (2.0 * kPI * one_minus_cos_max);
+    }
 };
 
 };
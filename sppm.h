@@ -0,0 +1,407 @@
+﻿#ifndef _SPPM_H_
+#define _SPPM_H_
+
+#include <iostream>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // _OPENMP
+
+#include "camera.h"
+#include "radiance.h"
+#include "photon_map.h"
+#include "ppm.h"
+#include "random.h"
+
+namespace gemspt {
+
+// Stochastic Progressive Photon Mapping
+// Hachisuka and Jensen. Stochastic Progressive Photon Mapping. SIGGRAPH Asia 2009.
+//
+// パスごとに、カメラからレイを飛ばして最初の非鏡面の交差点（可視点）を求め、光源から光子を追跡して
+// ハッシュグリッドに格納し、各可視点の周囲の光子を集める。集める半径はパスごとに縮めていく。
+// 可視点での直接光は光源サンプリングで求め、光子は一回以上反射したものだけを使う。
+// 光源から出てガラスを通って拡散面に届く光（コースティクス）はカメラからのパスでは見つけにくいが、光子なら容易に運べる。
+
+// 光子を放出する球光源
+// 不透明な物体に埋まっている部分からの光は外に出ないため、放出位置は埋まっていない部分を含む球冠に絞る。
+// 組み込みシーンの天井の光源のように、大部分が壁に埋まっている光源で光子を無駄にしないため。
+struct PhotonEmitter {
+    const SceneSphere *light;
+    Vec axis;              // 放出位置の球冠の中心方向
+    double cos_max;        // 球冠の範囲
+    double area;           // 球冠の面積
+    double power;          // 選択確率の計算用
+
+    PhotonEmitter(const SceneSphere *light) : light(light), axis(0.0, -1.0, 0.0), cos_max(-1.0) {
+        const double r = light->get_sphere()->radius();
+        area = 4.0 * kPI * r * r;
+        power = kPI * luminance(light->get_material()->emission()) * area;
+    }
+};
+
+// 光子と可視点で使う、不透明（光を通さない）物体かどうか。
+inline bool is_opaque(const SceneObject &object) {
+    return !object.get_material()->is_light() && !object.get_material()->is_specular();
+}
+
+// 点positionが不透明な物体の内部にあるか。内部を持つ球と無限平面（の裏側）だけを調べる。
+inline bool is_buried(const Scene &scene, const Vec &position) {
+    for (int i = 0; i < scene.num_spheres(); ++i) {
+        const SceneSphere &object = scene.sphere(i);
+        if (!is_opaque(object))
+            continue;
+        const Sphere *sphere = object.get_sphere();
+        if ((position - sphere->position()).length_squared() < sphere->radius() * sphere->radius())
+            return true;
+    }
+    for (int i = 0; i < scene.num_planes(); ++i) {
+        const ScenePlane &object = scene.plane(i);
+        if (is_opaque(object) && object.get_plane()->height(position) < 0.0)
+            return true;
+    }
+    return false;
+}
+
+// 各光源について、不透明な物体に埋まっていない部分を含む最小の球冠を求める。
+inline std::vector<PhotonEmitter> setup_photon_emitters(const Scene &scene) {
+    std::vector<PhotonEmitter> emitters;
+    for (int i = 0; i < scene.num_lights(); ++i) {
+        PhotonEmitter emitter(&scene.light(i));
+        const Sphere *light = emitter.light->get_sphere();
+        const double r = light->radius();
+
+        for (int j = 0; j < scene.num_spheres(); ++j) {
+            const SceneSphere &object = scene.sphere(j);
+            if (!is_opaque(object))
+                continue;
+            const Sphere *sphere = object.get_sphere();
+            const Vec to_sphere = sphere->position() - light->position();
+            const double d = to_sphere.length();
+            if (d >= r + sphere->radius() || d + sphere->radius() <= r)
+                continue; // 交わらない、または光源の内側にある
+            if (d + r <= sphere->radius()) {
+                emitter.area = 0.0; // 完全に埋まっている
+                break;
+            }
+
+            // 光源の表面のうちsphereに埋まっているのは、to_sphere方向との角度のcosがc0より大きい部分。
+            // 埋まっていないのはその反対側の球冠になる。
+            const double c0 = (r * r + d * d - sphere->radius() * sphere->radius()) / (2.0 * r * d);
+            const double area = 2.0 * kPI * r * r * (1.0 + c0);
+            if (area < emitter.area) {
+                emitter.axis = -to_sphere / d;
+                emitter.cos_max = -c0;
+                emitter.area = area;
+            }
+        }
+
+        // 平面の裏側に埋まっていないのは、法線方向との角度のcosが-h/rより大きい球冠になる（hは光源の中心の高さ）。
+        for (int j = 0; j < scene.num_planes() && emitter.area > 0.0; ++j) {
+            const ScenePlane &object = scene.plane(j);
+            if (!is_opaque(object))
+                continue;
+            const Plane *plane = object.get_plane();
+            const double cos_max = -plane->height(light->position()) / r;
+            if (cos_max <= -1.0)
+                continue; // 全く埋まっていない
+            if (cos_max >= 1.0) {
+                emitter.area = 0.0; // 完全に埋まっている
+                break;
+            }
+
+            const double area = 2.0 * kPI * r * r * (1.0 - cos_max);
+            if (area < emitter.area) {
+                emitter.axis = plane->normal();
+                emitter.cos_max = cos_max;
+                emitter.area = area;
+            }
+        }
+        emitter.power = kPI * luminance(emitter.light->get_material()->emission()) * emitter.area;
+        if (emitter.power > 0.0)
+            emitters.push_back(emitter);
+    }
+    return emitters;
+}
+
+// 光子を一つ放出して追跡し、拡散面に到達するたびにphotonsに加える。
+// emitter_cdfは光源をパワーに比例して選ぶための累積分布。
+// 放出位置が不透明な物体に埋まっていたら何もしない（パワー0の光子として数える）。
+inline void trace_photon(const Scene &scene, const std::vector<PhotonEmitter> &emitters, const std::vector<double> &emitter_cdf,
+                         Random &random, std::vector<Photon> *photons) {
+    const int kDepthLimit = 10;
+
+    // 光源をパワーに比例して選ぶ。
+    const double u = random.next01() * emitter_cdf.back();
+    int index = 0;
+    while (index + 1 < (int)emitters.size() && emitter_cdf[index] <= u)
+        ++index;
+    const PhotonEmitter &emitter = emitters[index];
+    const double selection_pdf = emitter.power / emitter_cdf.back();
+
+    // 球冠上の一様な点から、法線周りのcos分布の方向に放出する。
+    const Sphere *sphere = emitter.light->get_sphere();
+    Vec tangent, binormal;
+    createOrthoNormalBasis(emitter.axis, &tangent, &binormal);
+    const Vec normal = Sampling::uniformCone(random, 1.0 - emitter.cos_max, emitter.axis, tangent, binormal);
+    const Vec origin = sphere->position() + normal * sphere->radius();
+    if (is_buried(scene, origin))
+        return;
+
+    createOrthoNormalBasis(normal, &tangent, &binormal);
+    const Vec dir = Sampling::cosineWeightedHemisphereSurface(random, normal, tangent, binormal);
+
+    // 光子のパワー: Le * cosθ / (pdf_position * pdf_direction) = Le * π * area
+    Color power = emitter.light->get_material()->emission() * (kPI * emitter.area / selection_pdf);
+    Ray ray(origin, dir);
+    for (int depth = 0; depth < kDepthLimit; ++depth) {
+        Hitpoint hitpoint;
+        const SceneObject *now_object = scene.intersect(ray, &hitpoint);
+        if (now_object == NULL)
+            return;
+
+        // 光源は反射率0と仮定している。
+        const Material *now_material = now_object->get_material();
+        if (now_material->is_light())
+            return;
+
+        // 光源から直接届いた光子は可視点での光源サンプリングで扱うので格納しない。
+        if (!now_material->is_specular() && depth > 0)
+            photons->push_back(Photon(hitpoint.position, ray.dir, power));
+
+        double pdf = -1;
+        Color brdf_value;
+        const Vec dir_out = now_material->sample(random, ray.dir, hitpoint.normal, &pdf, &brdf_value);
+        const double cost = dot(hitpoint.normal, dir_out);
+        if (!now_material->is_specular() && (cost <= 0.0 || pdf <= 0.0))
+            return;
+        const Color new_power = multiply(power, brdf_value) * cost / pdf;
+
+        // ロシアンルーレット。反射でパワーが減った割合を生き残る確率にする。
+        // GlassMaterialでは球に入るときと出るときで符号が反転して打ち消し合うため、途中の値は負になりうる。
+        const double survival = std::min(1.0, fabs(luminance(new_power)) / fabs(luminance(power)));
+        if (!(survival > 0.0) || random.next01() >= survival)
+            return;
+        power = new_power / survival;
+        ray = Ray(hitpoint.position, dir_out);
+    }
+}
+
+// 可視点での直接光。光源サンプリングとBRDFサンプリングをMISで組み合わせる。
+inline Color direct_light_at_visible_point(const Scene &scene, const Ray &ray, const Hitpoint &hitpoint, const Material *material, Random &random) {
+    const Color light_sampled = sample_direct_light(scene, ray, hitpoint, material, NULL, NULL, random);
+
+    double pdf = -1;
+    Color brdf_value;
+    const Vec dir = material->sample(random, ray.dir, hitpoint.normal, &pdf, &brdf_value);
+    const double cost = dot(hitpoint.normal, dir);
+    if (cost <= 0.0 || pdf <= 0.0)
+        return light_sampled;
+
+    Hitpoint light_hitpoint;
+    const SceneObject *object = scene.intersect(Ray(hitpoint.position, dir), &light_hitpoint);
+    if (object == NULL || !object->get_material()->is_light())
+        return light_sampled;
+    const Color emission = object->get_material()->emission();
+
+    const double light_pdf = scene.light_pdf(object, hitpoint.position, hitpoint.normal);
+    return light_sampled + multiply(brdf_value, emission) * cost * mis_weight(pdf, light_pdf) / pdf;
+}
+
+// ピクセルごとのSPPMの統計量と、現在のパスの可視点。
+struct SPPMPixel {
+    double radius;
+    double num_photon;  // 累積の光子数N
+    Color flux;         // 累積のflux τ
+    Color direct;       // 直接光（と光源を直接見た分）の合計
+
+    // 現在のパスの可視点
+    bool has_visible_point;
+    Vec position, normal, in;
+    const Material *material;
+    Color weight;       // カメラから可視点までのスループット
+
+    SPPMPixel() : radius(0.0), num_photon(0.0), has_visible_point(false), material(NULL) {}
+};
+
+// 可視点の周囲の光子を集める。
+struct SPPMGather {
+    const SPPMPixel &pixel;
+    Color flux;
+    int count;
+
+    SPPMGather(const SPPMPixel &pixel) : pixel(pixel), count(0) {}
+
+    void operator()(const Photon &photon) {
+        // 面の表側から入ってきた光子だけを使う。
+        const Vec out = -photon.dir;
+        if (dot(out, pixel.normal) <= 0.0)
+            return;
+        flux = flux + multiply(pixel.material->eval(pixel.in, pixel.normal, out), photon.power);
+        ++count;
+    }
+};
+
+// SPPMでレンダリングしてimageに書き込む。
+// パスごとにカメラレイの位置をnum_subpixel x num_subpixelのサブピクセルの中心から順に選ぶので、
+// num_passがnum_subpixel^2の倍数ならrender_image()と同じ画像に収束する。
+void render_sppm_image(const Scene &scene, const int width, const int height, const int num_subpixel, const int num_pass,
+                       const int num_photon_per_pass, const double initial_radius, const unsigned long long seed, const bool show_progress, Color *image) {
+    // 半径の縮め方を決める定数。
+    const double kAlpha = 2.0 / 3.0;
+    const int kDepthLimit = 10;
+    const int kPhotonsPerTask = 1024;
+
+    const Camera camera = default_camera(width, height);
+    std::vector<SPPMPixel> pixels(width * height);
+    for (int i = 0; i < width * height; ++i)
+        pixels[i].radius = initial_radius;
+
+    const std::vector<PhotonEmitter> emitters = setup_photon_emitters(scene);
+    std::vector<double> emitter_cdf;
+    double total_power = 0.0;
+    for (size_t i = 0; i < emitters.size(); ++i) {
+        total_power += emitters[i].power;
+        emitter_cdf.push_back(total_power);
+    }
+
+#ifdef _OPENMP
+    const int num_buffer = omp_get_max_threads();
+#else
+    const int num_buffer = 1;
+#endif // _OPENMP
+    std::vector<std::vector<Photon> > photon_buffers(num_buffer);
+    std::vector<Photon> photons;
+    PhotonHashGrid grid;
+
+    for (int pass = 0; pass < num_pass; ++pass) {
+        if (show_progress)
+            std::cerr << "Rendering (pass = " << pass << ", " << (100.0 * pass / (num_pass - 1)) << " %)          \r";
+        const unsigned long long pass_seed = (seed * num_pass + pass) * width * height;
+
+        // 1. カメラから可視点を求める。
+        const int subpixel = pass % (num_subpixel * num_subpixel);
+        const double rate = (1.0 / num_subpixel);
+        const double r1 = (subpixel % num_subpixel) * rate + rate / 2.0;
+        const double r2 = (subpixel / num_subpixel) * rate + rate / 2.0;
+#pragma omp parallel for schedule(static) // OpenMP
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                Random random(pass_seed + y * width + x + 1);
+                SPPMPixel &pixel = pixels[(height - y - 1) * width + x];
+                pixel.has_visible_point = false;
+
+                Ray ray = camera.generate_ray(r1 + x, r2 + y);
+                Color weight(1.0, 1.0, 1.0);
+                for (int depth = 0; depth < kDepthLimit; ++depth) {
+                    Hitpoint hitpoint;
+                    const SceneObject *now_object = scene.intersect(ray, &hitpoint);
+                    if (now_object == NULL)
+                        break;
+
+                    const Material *now_material = now_object->get_material();
+                    if (now_material->is_light()) {
+                        pixel.direct = pixel.direct + multiply(weight, now_material->emission());
+                        break;
+                    }
+
+                    if (!now_material->is_specular()) {
+                        pixel.direct = pixel.direct + multiply(weight, direct_light_at_visible_point(scene, ray, hitpoint, now_material, random));
+                        pixel.has_visible_point = true;
+                        pixel.position = hitpoint.position;
+                        pixel.normal = hitpoint.normal;
+                        pixel.in = ray.dir;
+                        pixel.material = now_material;
+                        pixel.weight = weight;
+                        break;
+                    }
+
+                    double pdf = -1;
+                    Color brdf_value;
+                    const Vec dir_out = now_material->sample(random, ray.dir, hitpoint.normal, &pdf, &brdf_value);
+                    weight = multiply(weight, brdf_value) * dot(hitpoint.normal, dir_out) / pdf;
+                    ray = Ray(hitpoint.position, dir_out);
+                }
+            }
+        }
+
+        // 2. 光源から光子を追跡する。スレッドごとのバッファに格納してから一つにまとめる。
+        if (!emitters.empty()) {
+            const int num_task = (num_photon_per_pass + kPhotonsPerTask - 1) / kPhotonsPerTask;
+#pragma omp parallel for schedule(dynamic) // OpenMP
+            for (int task = 0; task < num_task; ++task) {
+#ifdef _OPENMP
+                std::vector<Photon> *buffer = &photon_buffers[omp_get_thread_num()];
+#else
+                std::vector<Photon> *buffer = &photon_buffers[0];
+#endif // _OPENMP
+                Random random((seed * num_pass + pass) * num_task + task + 1);
+                const int end = std::min(num_photon_per_pass, (task + 1) * kPhotonsPerTask);
+                for (int i = task * kPhotonsPerTask; i < end; ++i)
+                    trace_photon(scene, emitters, emitter_cdf, random, buffer);
+            }
+        }
+        photons.clear();
+        for (int i = 0; i < num_buffer; ++i) {
+            photons.insert(photons.end(), photon_buffers[i].begin(), photon_buffers[i].end());
+            photon_buffers[i].clear();
+        }
+
+        // 3. 現在の最大の半径をセルの大きさにしてグリッドを作り直し、各可視点で光子を集めて統計量を更新する。
+        double max_radius = 0.0;
+        for (int i = 0; i < width * height; ++i)
+            max_radius = std::max(max_radius, pixels[i].radius);
+        grid.build(photons, max_radius);
+
+#pragma omp parallel for schedule(dynamic, 64) // OpenMP
+        for (int i = 0; i < width * height; ++i) {
+            SPPMPixel &pixel = pixels[i];
+            if (!pixel.has_visible_point)
+                continue;
+
+            SPPMGather gather(pixel);
+            grid.gather(pixel.position, pixel.radius, gather);
+            if (gather.count == 0)
+                continue;
+
+            // 光子の一部(α)だけを統計量に加えたとみなして半径を縮める。
+            const double new_num_photon = pixel.num_photon + kAlpha * gather.count;
+            const double new_radius = pixel.radius * sqrt(new_num_photon / (pixel.num_photon + gather.count));
+            pixel.flux = (pixel.flux + multiply(pixel.weight, gather.flux)) * ((new_radius * new_radius) / (pixel.radius * pixel.radius));
+            pixel.num_photon = new_num_photon;
+            pixel.radius = new_radius;
+        }
+    }
+    if (show_progress)
+        std::cout << std::endl;
+
+    // 放射輝度の推定値: τ / (π r^2 N_emitted)
+    const double num_emitted = (double)num_photon_per_pass * num_pass;
+    for (int i = 0; i < width * height; ++i) {
+        const SPPMPixel &pixel = pixels[i];
+        image[i] = pixel.direct / (double)num_pass + pixel.flux / (kPI * pixel.radius * pixel.radius * num_emitted);
+    }
+}
+
+int render_sppm(const char *filename, const Scene &scene, const int width, const int height, const int num_subpixel, const int num_pass,
+                const int num_photon_per_pass, const double initial_radius, const int num_thread) {
+#ifdef _OPENMP
+    omp_set_num_threads(num_thread);
+#endif // _OPENMP
+
+    Color *image = new Color[width * height];
+    std::cout << width << "x" << height << " " << num_pass << " passes, " << num_photon_per_pass << " photons/pass" << std::endl;
+
+    render_sppm_image(scene, width, height, num_subpixel, num_pass, num_photon_per_pass, initial_radius, 0, true, image);
+
+    // 出力
+    save_ppm_file(filename, image, width, height);
+    delete[] image;
+
+    return 0;
+}
+
+};
+
+#endif
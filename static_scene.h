@@ -0,0 +1,144 @@
+﻿#ifndef _STATIC_SCENE_H_
+#define _STATIC_SCENE_H_
+
+#include <cmath>
+
+#include "vec.h"
+#include "ray.h"
+#include "scene.h"
+#include "constant.h"
+#include "hitpoint.h"
+
+namespace gemspt {
+
+// コンパイル時に配置が決まっている小さなシーンの交差判定
+// 物体の一覧をconstexprの配列で与え、テンプレートの再帰で物体ごとの交差判定を展開する。
+// 物体の個数と種類、座標、半径の二乗などが定数になるので、ループや物体の種類による分岐が無くなる。
+// 交差判定以外（マテリアル、光源のサンプリング）は同じ配置の実行時のSceneに任せる。
+// 配置はkSpheres（StaticSphereの配列）, kPlanes（StaticPlaneの配列）とその個数kNumSpheres, kNumPlanesを持つ型で与える。
+// 組み込みシーンの配置StaticBuiltinSceneはscene.hで定義し、実行時のSceneも同じ配列から作る。
+
+// Layout::kSpheres[I, N)との交差判定を展開する。
+// 交差点までの距離だけを求め、distanceより近ければdistanceとindexを更新する。
+template <typename Layout, int I, int N>
+struct StaticSphereIntersector {
+    static inline void intersect(const Ray &ray, double *distance, int *index) {
+        // 自己交差の判定用定数。Sphere::intersect()と同じ。
+        const double kEPS = 1e-6;
+
+        const double ox = Layout::kSpheres[I].x - ray.org.x;
+        const double oy = Layout::kSpheres[I].y - ray.org.y;
+        const double oz = Layout::kSpheres[I].z - ray.org.z;
+        const double b = ox * ray.dir.x + oy * ray.dir.y + oz * ray.dir.z;
+        const double c = b * b - (ox * ox + oy * oy + oz * oz) + Layout::kSpheres[I].radius_squared;
+        if (c >= 0.0) {
+            const double sqrt_c = sqrt(c);
+            const double t1 = b - sqrt_c, t2 = b + sqrt_c;
+            if (t1 >= kEPS || t2 >= kEPS) {
+                const double t = t1 > kEPS ? t1 : t2;
+                if (t < *distance) {
+                    *distance = t;
+                    *index = I;
+                }
+            }
+        }
+        StaticSphereIntersector<Layout, I + 1, N>::intersect(ray, distance, index);
+    }
+};
+
+template <typename Layout, int N>
+struct StaticSphereIntersector<Layout, N, N> {
+    static inline void intersect(const Ray &, double *, int *) {}
+};
+
+// Layout::kPlanes[I, N)との交差判定を展開する。indexには平面の番号を入れる。
+template <typename Layout, int I, int N>
+struct StaticPlaneIntersector {
+    static inline void intersect(const Ray &ray, double *distance, int *index) {
+        // 自己交差の判定用定数。Plane::intersect()と同じ。
+        const double kEPS = 1e-6;
+
+        const double nx = Layout::kPlanes[I].nx, ny = Layout::kPlanes[I].ny, nz = Layout::kPlanes[I].nz;
+        const double cos_dir = nx * ray.dir.x + ny * ray.dir.y + nz * ray.dir.z;
+        if (cos_dir != 0.0) {
+            const double height = (nx * ray.org.x + ny * ray.org.y + nz * ray.org.z) - Layout::kPlanes[I].offset;
+            const double t = -height / cos_dir;
+            if (t >= kEPS && t < *distance) {
+                *distance = t;
+                *index = I;
+            }
+        }
+        StaticPlaneIntersector<Layout, I + 1, N>::intersect(ray, distance, index);
+    }
+};
+
+template <typename Layout, int N>
+struct StaticPlaneIntersector<Layout, N, N> {
+    static inline void intersect(const Ray &, double *, int *) {}
+};
+
+// 配置Layoutがコンパイル時に決まっているシーン。
+// Sceneと同じインターフェース（intersect, sample_light, light_pdf）を持つので、render_image()などにそのまま渡せる。
+// マテリアルと光源は、Layoutの平面、球の順に物体を追加した実行時のSceneで扱う。
+template <typename Layout>
+class StaticScene {
+private:
+    Scene scene_;
+
+    StaticScene(const StaticScene&);
+    StaticScene& operator=(const StaticScene&);
+public:
+    // plane_materials[i]をLayout::kPlanes[i]に、sphere_materials[i]をLayout::kSpheres[i]に割り当てる。
+    // マテリアルの所有権はシーンに移る。
+    StaticScene(const Material *const plane_materials[Layout::kNumPlanes], const Material *const sphere_materials[Layout::kNumSpheres]) {
+        for (int i = 0; i < Layout::kNumPlanes; ++i)
+            scene_.add(Layout::kPlanes[i].plane(), plane_materials[i]);
+        for (int i = 0; i < Layout::kNumSpheres; ++i)
+            scene_.add(Layout::kSpheres[i].sphere(), sphere_materials[i]);
+        scene_.build();
+    }
+
+    // 同じ配置の実行時のシーン。
+    const Scene& runtime_scene() const {
+        return scene_;
+    }
+
+    // シーンとの交差判定関数。Scene::intersect()と同じ結果を返す。
+    // 展開した交差判定では距離だけを求め、交差点と法線は最も近い物体についてだけ計算する。
+    inline const SceneObject* intersect(const Ray &ray, Hitpoint *hitpoint) const {
+        double distance = kINF;
+        int sphere_index = -1, plane_index = -1;
+        StaticSphereIntersector<Layout, 0, Layout::kNumSpheres>::intersect(ray, &distance, &sphere_index);
+        StaticPlaneIntersector<Layout, 0, Layout::kNumPlanes>::intersect(ray, &distance, &plane_index);
+
+        *hitpoint = Hitpoint();
+        if (plane_index >= 0) {
+            // 平面は球の後に調べているので、平面が見つかればそれが最も近い。
+            const Plane *plane = scene_.plane(plane_index).get_plane();
+            hitpoint->distance = distance;
+            hitpoint->position = ray.org + distance * ray.dir;
+            hitpoint->normal   = plane->normal();
+            return &scene_.plane(plane_index);
+        }
+        if (sphere_index >= 0) {
+            const Sphere *sphere = scene_.sphere(sphere_index).get_sphere();
+            hitpoint->distance = distance;
+            hitpoint->position = ray.org + distance * ray.dir;
+            hitpoint->normal   = normalize(hitpoint->position - sphere->position());
+            return &scene_.sphere(sphere_index);
+        }
+        return NULL;
+    }
+
+    const SceneSphere* sample_light(Random &random, const Vec &position, const Vec &normal, double *pdf) const {
+        return scene_.sample_light(random, position, normal, pdf);
+    }
+
+    double light_pdf(const SceneObject *object, const Vec &position, const Vec &normal) const {
+        return scene_.light_pdf(object, position, normal);
+    }
+};
+
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define	_VEC_H_
 
 #include <cmath>
+#include <algorithm>
 
 #include "constant.h"
 
@@ -59,6 +60,20 @@ inline Vec cross(const Vec &v1, const Vec &v2) {
         (v1.x * v2.y) - (v1.y * v2.x));
 }
 
+// 成分ごとの最小値・最大値
+inline Vec component_min(const Vec &v1, const Vec &v2) {
+    return Vec(std::min(v1.x, v2.x), std::min(v1.y, v2.y), std::min(v1.z, v2.z));
+}
+
+inline Vec component_max(const Vec &v1, const Vec &v2) {
+    return Vec(std::max(v1.x, v2.x), std::max(v1.y, v2.y), std::max(v1.z, v2.z));
+}
+
+// axis番目（0: x, 1: y, 2: z）の成分
+inline double component(const Vec &v, const int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
 inline Vec reflect(const Vec &in, const Vec &normal) {
     return normalize(in - normal * 2.0 * dot(normal, in));
 }